@@ -73,5 +73,14 @@ int main(int argc, char* argv[])
 #endif
     };
 
+#if !defined(_WIN32) && !defined(_WIN64)
+    // 150 ms of 2 s some tasks stalled waiting for memory, a good time to shrink caches
+    svParam.vPressureTriggers.push_back({ "memory", false, false, 150000, 2000000 });
+    svParam.fnPressureCallBack = [](const SrvPressureTrigger& Trigger)
+    {
+        syslog(LOG_NOTICE, "PressureCallBack called for %s", Trigger.strResource.c_str());
+    };
+#endif
+
     return ServiceMain(argc, argv, svParam);
 }
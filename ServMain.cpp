@@ -11,6 +11,8 @@
 */
 
 #include "Service.h"
+#include "SrvTrace.h"
+#include "SrvHost.h"
 
 #include <iostream>
 #include <memory>
@@ -38,7 +40,22 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <pthread.h>
 #include <cstdlib>
+#include <cerrno>
+#include <fstream>
+#include "SrvFleet.h"
+#include "SrvFdStore.h"
+#include "SrvProfiler.h"
+#include "SrvHeap.h"
+#include "SrvNotify.h"
+#include "SrvWorkers.h"
+#include "SrvSpawner.h"
+#include "SrvStandby.h"
 class CBaseSrv
 {
 public:
@@ -52,90 +69,59 @@ public:
 
 using namespace std;
 
+// Connects the services with the Windows service control manager and the signals of the process
 class Service : public CBaseSrv
 {
 public:
-    static Service& GetInstance(const SrvParam* SrvPara = nullptr)
+    static Service& GetInstance(const vector<SrvParam>* vSrvPara = nullptr)
     {
-        if (SrvPara == nullptr && s_pInstance == nullptr)
-            throw std::runtime_error("Wrong init, the first call to GetInstance must have a address of a SrvPara struct");
-        if (SrvPara == nullptr)
+        if (vSrvPara == nullptr && s_pInstance == nullptr)
+            throw std::runtime_error("Wrong init, the first call to GetInstance must have a address of the SrvPara list");
+        if (vSrvPara == nullptr)
             return *s_pInstance;
         if (s_pInstance == nullptr)
-            s_pInstance = Service::factory(SrvPara);
+            s_pInstance = Service::factory(vSrvPara);
         return *s_pInstance;
     }
 
     void Start() override
     {
-        m_bIsStopped = false;
-
-        if (fnStartCallBack != nullptr)
-            fnStartCallBack();
-
-        unique_lock<mutex> lock(m_mxStop);
-        m_cvStop.wait(lock, [&]() { return m_bStop; });
-
-        if (fnStopCallBack != nullptr)
-            fnStopCallBack();
-
-        m_bIsStopped = true;
+        m_Host.Run();
     }
 
     void Stop() noexcept override
     {
-        m_bStop = true;
-        m_cvStop.notify_all();
-    }
-
-    void CallSignalCallback()
-    {
-        if (fnSignalCallBack != nullptr)
-            fnSignalCallBack();
+        m_Host.Stop();
     }
 
-    bool IsStopped() noexcept { return m_bIsStopped; }
+    CSrvHost& GetHost() noexcept { return m_Host; }
 
     static void SignalHandler(int iSignal)
     {
+        if (s_pInstance == nullptr)
+            return;
+        s_pInstance->m_Host.Signal(iSignal);
 #if defined(_WIN32) || defined(_WIN64)
-        if (iSignal == SIGINT)
-        {
-            Service::GetInstance().CallSignalCallback();
-            signal(SIGINT, Service::SignalHandler);
-        }
-#else
-        if (iSignal == SIGQUIT)
-            Service::GetInstance().Stop();
-        else if (iSignal == SIGHUP)
-            Service::GetInstance().CallSignalCallback();
+        signal(SIGINT, Service::SignalHandler);
 #endif
     }
 
-    static unique_ptr<Service> factory(const SrvParam* SrvPara = nullptr)
+    static unique_ptr<Service> factory(const vector<SrvParam>* vSrvPara = nullptr)
     {
         struct EnableMaker : public Service
         {
-            explicit EnableMaker(const SrvParam* SrvPara = nullptr) : Service(SrvPara) {}
+            explicit EnableMaker(const vector<SrvParam>* vSrvPara = nullptr) : Service(vSrvPara) {}
             using Service::Service;
         };
-        return make_unique<EnableMaker>(SrvPara);
+        return make_unique<EnableMaker>(vSrvPara);
     }
 
 private:
-    explicit Service(const SrvParam* SrvPara) : CBaseSrv(SrvPara->szSrvName), m_bStop(false), m_bIsStopped(true),
-        fnStartCallBack(SrvPara->fnStartCallBack), fnStopCallBack(SrvPara->fnStopCallBack), fnSignalCallBack(SrvPara->fnSignalCallBack) { }
+    explicit Service(const vector<SrvParam>* vSrvPara) : CBaseSrv(vSrvPara->front().szSrvName), m_Host(*vSrvPara) { }
 
 private:
     static unique_ptr<Service> s_pInstance;
-    bool m_bStop;
-    bool m_bIsStopped;
-    mutex              m_mxStop;
-    condition_variable m_cvStop;
-    function<void()> fnStartCallBack;
-    function<void()> fnStopCallBack;
-    function<void()> fnSignalCallBack;
-
+    CSrvHost m_Host;
 };
 
 unique_ptr<Service> Service::s_pInstance;
@@ -150,11 +136,31 @@ DWORD WINAPI RemoteThreadProc(LPVOID/* lpParameter*/) noexcept
 
 int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
 {
+    return ServiceMain(argc, argv, vector<SrvParam>{ SrvPara });
+}
+
+int ServiceMain(int argc, char* argv[], const vector<SrvParam>& vSrvPara)
+{
+    if (vSrvPara.empty() == true)
+        return EXIT_FAILURE;
+#if !defined(_WIN32) && !defined(_WIN64)
+    // we are a helper of CSrvSpawner, started from the service
+    const int iHelperExit = CSrvSpawner::HelperMain(argc, argv);
+    if (iHelperExit >= 0)
+        return iHelperExit;
+#endif
+    // the first service names the process, the pid file and the Windows service
+    const SrvParam& SrvPara = vSrvPara.front();
+
 #if defined(_WIN32) || defined(_WIN64)
     signal(SIGINT, Service::SignalHandler);
 #else
     signal(SIGHUP, Service::SignalHandler);
     signal(SIGQUIT, Service::SignalHandler);
+    signal(SIGUSR1, Service::SignalHandler);
+    signal(SIGUSR2, Service::SignalHandler);
+    signal(CSrvProfiler::GetSignal(), Service::SignalHandler);
+    signal(CSrvHeap::GetSignal(), Service::SignalHandler);
 
     auto fnWS2S = [](const wstring& src) -> string
     {
@@ -166,6 +172,15 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
     string strSrvName = fnWS2S(SrvPara.szSrvName);
     char* szEnv = getenv("RUNTIME_DIRECTORY");
     string strRunTimeDir = szEnv != nullptr ? szEnv : "/var/run/";
+    string strTraceFile = strRunTimeDir + "/" + strSrvName + ".trace.json";
+    string strStatsFile = strRunTimeDir + "/" + strSrvName + ".stats";
+    string strProfileFile = strRunTimeDir + "/" + strSrvName + ".folded";
+
+    // LISTEN_PID is the pid systemd started, take the fds of the fd store before we fork
+    CSrvFdStore::Init();
+
+    // hot standby: a relative lock file is in the runtime directory, the two instances need a common one
+    const string strLockFile = SrvPara.strLockFile.empty() == true || SrvPara.strLockFile[0] == '/' ? SrvPara.strLockFile : strRunTimeDir + "/" + SrvPara.strLockFile;
 
     auto _kbhit = []() -> int
     {
@@ -239,6 +254,7 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
                         {
                             //wcout << strName.c_str() << L" = " << (pid_t)lpid << endl;
                             kill(static_cast<pid_t>(lpid), iSignal);
+                            fclose(fp);
                             break;
                         }
                     }
@@ -248,10 +264,90 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
             closedir(dir);
         }
     };
+
+    // We are PID 1 in a container. We stay in the foreground, reap all children and forward the termination signals
+    auto fnRunAsInit = [&]() -> int
+    {
+        sigset_t sigMask;
+        sigemptyset(&sigMask);
+        for (const int iSignal : { SIGCHLD, SIGTERM, SIGINT, SIGQUIT, SIGHUP, SIGUSR1, SIGUSR2, CSrvProfiler::GetSignal(), CSrvHeap::GetSignal() })
+            sigaddset(&sigMask, iSignal);
+        // block the signals before the first thread is created, all threads inherit the mask
+        sigprocmask(SIG_BLOCK, &sigMask, nullptr);
+        pthread_atfork(nullptr, nullptr, []()
+        {
+            sigset_t sigEmpty;
+            sigemptyset(&sigEmpty);
+            sigprocmask(SIG_SETMASK, &sigEmpty, nullptr);
+        });
+
+        const int fdSignal = signalfd(-1, &sigMask, SFD_NONBLOCK | SFD_CLOEXEC);
+        const int fdDone = eventfd(0, EFD_CLOEXEC);
+        if (fdSignal < 0 || fdDone < 0)
+            return EXIT_FAILURE;
+
+        wcout << SrvPara.szSrvName << L" started as init process" << endl;
+
+        Service::GetInstance(&vSrvPara);
+        Service::GetInstance().GetHost().SetTraceFile(strTraceFile);
+        Service::GetInstance().GetHost().SetStatsFile(strStatsFile);
+        Service::GetInstance().GetHost().SetProfileFile(strProfileFile);
+        Service::GetInstance().GetHost().SetReadyCallBack([](bool bReady)
+        {
+            if (bReady == true)
+                CSrvNotify::Notify("READY=1");
+        });
+
+        thread th([&]() {
+            Service::GetInstance().Start();
+            const uint64_t nOne = 1;
+            if (write(fdDone, &nOne, sizeof(nOne)) < 0)
+                Service::GetInstance().Stop();
+        });
+
+        bool bRunning = true;
+        while (bRunning == true)
+        {
+            pollfd fds[2] = { { fdSignal, POLLIN, 0 }, { fdDone, POLLIN, 0 } };
+            if (poll(fds, 2, -1) < 0)
+                continue;
+            if ((fds[1].revents & POLLIN) != 0)
+                bRunning = false;
+
+            signalfd_siginfo si;
+            while (read(fdSignal, &si, sizeof(si)) == sizeof(si))
+            {
+                const int iSignal = static_cast<int>(si.ssi_signo);
+                if (iSignal == SIGCHLD)
+                {
+                    while (waitpid(-1, nullptr, WNOHANG) > 0);
+                }
+                else if (iSignal == SIGHUP || iSignal == SIGUSR1 || iSignal == SIGUSR2 || iSignal == CSrvProfiler::GetSignal() || iSignal == CSrvHeap::GetSignal())
+                    Service::SignalHandler(iSignal);
+                else
+                {   // SIGTERM, SIGINT and SIGQUIT stop the service the graceful way, all other processes of the container get the signal too
+                    Service::GetInstance().Stop();
+                    kill(-1, iSignal);
+                }
+            }
+        }
+
+        if (th.joinable() == true)
+            th.join();
+        while (waitpid(-1, nullptr, WNOHANG) > 0);
+
+        close(fdDone);
+        close(fdSignal);
+        wcout << SrvPara.szSrvName << L" stopped" << endl;
+        return 0;
+    };
 #endif
 
     int iRet{0};
 
+    if (SrvPara.bEnableTrace == true || getenv("SRVLIB_TRACE") != nullptr)
+        CSrvTrace::Enable(true);
+
     if (argc > 1)
     {
         while (++argv, --argc)
@@ -275,12 +371,36 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
 #if defined(_WIN32) || defined(_WIN64)
                     iRet = CSvrCtrl().Stop(SrvPara.szSrvName);
 #else
-                    fnSendSignal(SIGQUIT);
-                    struct stat st;
-                    while (stat(std::string(strRunTimeDir + "/" + strSrvName + ".pid").c_str(), &st) == 0)
-                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                {
+                    // wait on the pidfd until the process has ended, without pidfd support we poll the pid file.
+                    // The daemon is this program, a pid of the pid file with another name is not our daemon
+                    string strMyName;
+                    ifstream finComm("/proc/self/comm");
+                    getline(finComm, strMyName);
+                    const pid_t nPid = CSrvFleet(strRunTimeDir, strMyName).FindPid(strSrvName);
+                    if (nPid > 0 && kill(nPid, SIGQUIT) == 0 && CSrvFleet::WaitForExit(nPid, chrono::milliseconds(-1)) < 0)
+                    {
+                        struct stat st;
+                        while (stat(std::string(strRunTimeDir + "/" + strSrvName + ".pid").c_str(), &st) == 0)
+                            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    }
+                }
 #endif
                     break;
+#if !defined(_WIN32) && !defined(_WIN64)
+                case 'T':
+                    fnSendSignal(SIGUSR1);
+                    break;
+                case 'Q':
+                    fnSendSignal(SIGUSR2);
+                    break;
+                case 'P':
+                    fnSendSignal(CSrvProfiler::GetSignal());
+                    break;
+                case 'M':
+                    fnSendSignal(CSrvHeap::GetSignal());
+                    break;
+#endif
 #if defined(_WIN32) || defined(_WIN64)
                 case 'P':
                     iRet = CSvrCtrl().Pause(SrvPara.szSrvName);
@@ -291,13 +411,41 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
 #endif
                 case 'F':
                 {
+#if !defined(_WIN32) && !defined(_WIN64)
+                    if (getpid() == 1)
+                    {
+                        iRet = fnRunAsInit();
+                        break;
+                    }
+#endif
+#if !defined(_WIN32) && !defined(_WIN64)
+                    if (strLockFile.empty() == false
+                        && CSrvStandby::Lock(strLockFile, SrvPara.fnWarmUpCallBack, [&]() { wcout << SrvPara.szSrvName << L" is standby" << endl; }) == false)
+                    {
+                        iRet = EXIT_FAILURE;
+                        break;
+                    }
+#endif
                     wcout << SrvPara.szSrvName << L" started" << endl;
 
-                    Service::GetInstance(&SrvPara);
+                    Service::GetInstance(&vSrvPara);
+#if !defined(_WIN32) && !defined(_WIN64)
+                    Service::GetInstance().GetHost().SetTraceFile(strTraceFile);
+                    Service::GetInstance().GetHost().SetStatsFile(strStatsFile);
+                    Service::GetInstance().GetHost().SetProfileFile(strProfileFile);
+#endif
 
-                    thread th([&]() {
-                        Service::GetInstance().Start();
+#if !defined(_WIN32) && !defined(_WIN64)
+                    Service::GetInstance().GetHost().SetReadyCallBack([](bool bReady)
+                    {
+                        if (bReady == true)
+                        {
+                            CSrvStandby::SetReady();
+                            CSrvNotify::Notify("READY=1");
+                        }
                     });
+#endif
+                    thread thHost([]() { Service::GetInstance().Start(); });
 
                     const wchar_t caZeichen[] = L"\\|/-";
                     int iIndex{0};
@@ -310,8 +458,7 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
 
                     wcout << SrvPara.szSrvName << L" stopped" << endl;
                     Service::GetInstance().Stop();
-                    if (th.joinable() == true)
-                        th.join();
+                    thHost.join();
                 }
                 break;
                 case 'K':
@@ -476,6 +623,12 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
 #endif
                     wcout << L"-f   Start the application as a console application\r\n";
                     wcout << L"-k   Reload configuration\r\n";
+#if !defined(_WIN32) && !defined(_WIN64)
+                    wcout << L"-t   Write the trace events to <name>.trace.json in the runtime directory\r\n";
+                    wcout << L"-q   Write the statistics to <name>.stats in the runtime directory\r\n";
+                    wcout << L"-p   Start the profiler, the next -p writes the folded stacks to <name>.folded\r\n";
+                    wcout << L"-m   Give the free heap memory back to the system (malloc_trim)\r\n";
+#endif
                     wcout << L"-h   Show this help\r\n";
                     return iRet;
                 }
@@ -485,12 +638,20 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
     else
     {
 #if !defined(_WIN32) && !defined(_WIN64)
+        if (getpid() == 1)
+            return fnRunAsInit();
+
         //Set our Logging Mask and open the Log
         setlogmask(LOG_UPTO(LOG_NOTICE));
         openlog(strSrvName.c_str(), LOG_CONS | LOG_NDELAY | LOG_PERROR | LOG_PID, LOG_USER);
 
         syslog(LOG_NOTICE, "%s", string("Starting " + strSrvName).c_str());
 
+        // the started process waits until the service is ready, the daemon sends 1 if all init tasks succeeded
+        int fdReady[2] = { -1, -1 };
+        if (pipe2(fdReady, O_CLOEXEC) < 0)
+            exit(EXIT_FAILURE);
+
         //Fork the Parent Process
         pid_t pid = fork();
 
@@ -499,7 +660,14 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
 
         //We got a good pid, Close the Parent Process
         if (pid > 0)
-            return iRet;
+        {
+            close(fdReady[1]);
+            char cReady{0};
+            while (read(fdReady[0], &cReady, 1) < 0 && errno == EINTR);
+            close(fdReady[0]);
+            return cReady == 1 ? iRet : EXIT_FAILURE;
+        }
+        close(fdReady[0]);
 
         //Create a new Signature Id for our child
         pid_t sid = setsid();
@@ -514,7 +682,31 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
 
         //We got a good pid, Close the Parent Process
         if (pid > 0)
+        {
+            close(fdReady[1]);
             return iRet;
+        }
+
+        // the standby ends the starting process when it is warm, the pid file names the active instance
+        if (strLockFile.empty() == false && CSrvStandby::Lock(strLockFile, SrvPara.fnWarmUpCallBack, [&fdReady]()
+            {
+                const char cReady = 1;
+                if (write(fdReady[1], &cReady, 1) < 0)
+                    syslog(LOG_WARNING, "the starting process is gone");
+                close(fdReady[1]);
+                fdReady[1] = -1;
+                // don't keep the terminal or a pipe of the caller open while waiting
+                const int fdNull = open("/dev/null", O_RDWR);
+                for (const int fd : { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO })
+                    dup2(fdNull, fd);
+                if (fdNull > STDERR_FILENO)
+                    close(fdNull);
+            }) == false)
+        {
+            if (fdReady[1] >= 0)
+                close(fdReady[1]);
+            return EXIT_FAILURE;
+        }
 
         int fdPidFile = open(std::string(strRunTimeDir + "/" + strSrvName + ".pid").c_str(), O_CREAT | O_RDWR, S_IRWXU | S_IRWXG  | S_IRWXO);
         if (fdPidFile >= 0)
@@ -532,8 +724,62 @@ int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara)
         close(STDOUT_FILENO);
         close(STDERR_FILENO);
 #endif
-        Service::GetInstance(&SrvPara);
+#if !defined(_WIN32) && !defined(_WIN64)
+        auto fnReady = [&fdReady](bool bReady)
+        {
+            if (bReady == true)
+            {
+                CSrvStandby::SetReady();
+                CSrvNotify::Notify("READY=1");
+            }
+            if (fdReady[1] < 0)     // a standby ended the starting process already
+                return;
+            const char cReady = bReady == true ? 1 : 0;
+            if (write(fdReady[1], &cReady, 1) < 0)
+                syslog(LOG_WARNING, "the starting process is gone");
+            close(fdReady[1]);
+            fdReady[1] = -1;
+        };
+
+        if (SrvPara.nWorkers > 0)
+        {   // we are the master, the service runs in the workers, each with its own files in the runtime directory
+            CSrvWorkers Workers(SrvPara, [&](uint32_t nIndex, int fdWorkerReady) -> int
+            {
+                if (fdReady[1] >= 0)    // the workers started later don't have it
+                    close(fdReady[1]);
+                CSrvStandby::Detach();  // the lock stays with the master
+                const string strWorker = strRunTimeDir + "/" + strSrvName + "." + to_string(nIndex);
+                Service::GetInstance(&vSrvPara);
+                Service::GetInstance().GetHost().SetTraceFile(strWorker + ".trace.json");
+                Service::GetInstance().GetHost().SetStatsFile(strWorker + ".stats");
+                Service::GetInstance().GetHost().SetProfileFile(strWorker + ".folded");
+                Service::GetInstance().GetHost().SetReadyCallBack([fdWorkerReady](bool bReady)
+                {
+                    const char cReady = bReady == true ? 1 : 0;
+                    if (write(fdWorkerReady, &cReady, 1) < 0)
+                        syslog(LOG_WARNING, "the master process is gone");
+                    close(fdWorkerReady);
+                });
+                const int iWorkerExit = Service::GetInstance().Run();
+                return Service::GetInstance().GetHost().IsIdleStop() == true ? CSrvWorkers::EXIT_IDLE : iWorkerExit;
+            });
+            Workers.SetStatsFile(strStatsFile);
+            Workers.SetReadyCallBack(fnReady);
+            iRet = Workers.Run();
+        }
+        else
+        {
+            Service::GetInstance(&vSrvPara);
+            Service::GetInstance().GetHost().SetTraceFile(strTraceFile);
+            Service::GetInstance().GetHost().SetStatsFile(strStatsFile);
+            Service::GetInstance().GetHost().SetProfileFile(strProfileFile);
+            Service::GetInstance().GetHost().SetReadyCallBack(fnReady);
+            iRet = Service::GetInstance().Run();
+        }
+#else
+        Service::GetInstance(&vSrvPara);
         iRet = Service::GetInstance().Run();
+#endif
 #if !defined(_WIN32) && !defined(_WIN64)
         syslog(LOG_NOTICE, "%s", string(strSrvName + " gestoppt").c_str());
         unlink(std::string(strRunTimeDir + "/" + strSrvName + ".pid").c_str());
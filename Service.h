@@ -2,7 +2,35 @@
 #ifndef SERVICE_H
 #define SERVICE_H
 
+#include <cstdint>
 #include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef struct
+{
+    std::string strName;                    // cgroup name, threads join it with CSrvCgroup::JoinThread (SrvCgroup.h)
+    uint32_t nCpuWeight;                    // cpu.weight 1 - 10000, 0 = default (100)
+    uint32_t nCpuMaxPercent;                // cpu.max in percent of one cpu, 0 = no limit
+}SrvThreadGroup;
+
+typedef struct
+{
+    std::string strResource;                // "cpu", "memory" or "io", or the path of a *.pressure file
+    bool bCgroup;                           // use the *.pressure file of the service cgroup instead of /proc/pressure
+    bool bFull;                             // "full" stall (all tasks stalled) instead of "some"
+    uint32_t nStallUs;                      // stall time in the window that triggers the callback
+    uint32_t nWindowUs;                     // 500000 - 10000000, without privileges a multiple of 2000000
+}SrvPressureTrigger;
+
+typedef struct
+{
+    std::string strName;                    // unique name, used in the statistics and the trace
+    std::vector<std::string> vDependsOn;    // names of the tasks that must be initialized before this one
+    std::function<void()> fnInit;           // an exception stops the start of the service
+    std::function<void()> fnExit;           // called at stop, after all tasks depending on this one have exited
+}SrvTask;
 
 typedef struct
 {
@@ -14,8 +42,38 @@ typedef struct
     std::function<void()> fnStartCallBack;
     std::function<void()> fnStopCallBack;
     std::function<void()> fnSignalCallBack;
+    bool bEnableTrace = false;              // Record trace events, also enabled by the environment variable SRVLIB_TRACE
+    std::vector<SrvThreadGroup> vThreadGroups;  // Linux: threaded child cgroups, needs Delegate=yes in the unit file
+    uint64_t nMemoryHigh = 0;               // Linux: memory.high of the service cgroup in bytes, 0 = unchanged
+    std::vector<SrvPressureTrigger> vPressureTriggers;  // Linux: PSI triggers, calling fnPressureCallBack
+    std::function<void(const SrvPressureTrigger&)> fnPressureCallBack;
+    uint32_t nThreadStatsMs = 0;            // Linux: interval of the per thread cpu and context switch statistics, 0 = off
+    uint32_t nMallocArenaMax = 0;           // Linux/glibc: mallopt M_ARENA_MAX, 0 = default (8 * number of cpus)
+    std::vector<std::pair<int, int>> vMallopt;  // Linux/glibc: more mallopt settings, e.g. { M_TRIM_THRESHOLD, 1 << 20 }
+    uint32_t nMallocTrimIdleMs = 0;         // Linux/glibc: malloc_trim if the service was idle (< 1% cpu) this time, 0 = off
+    uint32_t nStallThresholdMs = 0;         // Linux: log the backtrace of event loop callbacks running longer, 0 = off
+    uint32_t nSpawnHelpers = 0;             // Linux: helper processes running the programs of CSrvSpawner::Spawn, 0 = none
+    std::vector<std::string> vWatchFiles;   // Linux: configuration files, a change calls fnSignalCallBack like SIGHUP
+    uint32_t nWatchDebounceMs = 50;         // Linux: a burst of changes of vWatchFiles is one reload when it is quiet this time
+    uint32_t nIdleTimeoutMs = 0;            // Linux: stop the service if CSrvIdle saw no activity this time, 0 = never
+    uint32_t nWorkers = 0;                  // Linux: the daemon is the master of this many worker processes, 0 = no workers
+    uint64_t nWorkerMaxRssKb = 0;           // Linux: a worker is replaced above this rss, 0 = no limit
+    uint32_t nWorkerMaxFds = 0;             // Linux: a worker is replaced with more open fds, 0 = no limit
+    uint32_t nWorkerMaxAgeS = 0;            // Linux: a worker is replaced after this time, 0 = no limit
+    uint32_t nWorkerJitterPct = 10;         // Linux: the age limit of each worker is up to this percentage shorter
+    uint32_t nWorkerDrainMs = 30000;        // Linux: a retired worker is killed if it did not stop in this time
+    std::string strModule;                  // Linux: shared object with the service logic (SrvModule.h), a new version is swapped in on reload
+    std::string strLockFile;                // Linux: hot standby, the instance not getting the flock of this file waits for it
+    std::function<void()> fnWarmUpCallBack; // Linux: with strLockFile before the lock, the standby is warm when it takes over
+    std::function<std::string()> fnSerializeConfig;     // Linux: the master parses the configuration for the workers, see CSrvSharedConfig
+    std::vector<std::string> vDependencies; // Linux: "file:/path", "unix:/path" or "tcp:[address:]port", the start waits for them
+    uint32_t nDependencyTimeoutMs = 60000;  // Linux: the start fails if a dependency is still missing after this time, 0 = no limit
+    std::vector<SrvTask> vInitTasks;        // run in parallel before fnStartCallBack, the service is ready when all are done
+    uint32_t nInitThreads = 0;              // threads for the init tasks, 0 = number of cpus
 }SrvParam;
 
 int ServiceMain(int argc, char* argv[], const SrvParam& SrvPara);
+// several services in one process, see CSrvHost
+int ServiceMain(int argc, char* argv[], const std::vector<SrvParam>& vSrvPara);
 
 #endif // SERVICE_H
@@ -0,0 +1,162 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#include "SrvArena.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace std;
+
+namespace
+{
+    constexpr size_t BLOCK_SIZE = 64 * 1024;
+    constexpr size_t MAX_KEEP = 1024 * 1024;    // a thread keeps at most this much between the units of work
+
+    struct alignas(max_align_t) Block
+    {
+        Block* pNext;
+        size_t nSize;       // usable bytes after the header
+    };
+
+    atomic<uint64_t> s_nHighWater{0};       // largest unit of work of all threads
+    atomic<uint64_t> s_nReserved{0};        // bytes of the blocks of all threads
+    atomic<uint64_t> s_nBlockAllocs{0};
+    atomic<uint64_t> s_nResets{0};
+    atomic<uint64_t> s_nThreads{0};
+
+    struct ThreadArena
+    {
+        Block*  pBlocks{nullptr};   // the newest first
+        char*   pPos{nullptr};
+        char*   pEnd{nullptr};
+        size_t  nUsed{0};           // bytes since the last reset, with the alignment gaps
+        size_t  nReserved{0};
+        size_t  nHighWater{0};
+        int     nDepth{0};
+
+        ~ThreadArena()
+        {
+            if (nReserved != 0 || nHighWater != 0)
+                s_nThreads.fetch_sub(1, memory_order_relaxed);
+            FreeBlocks();
+        }
+
+        void FreeBlocks() noexcept
+        {
+            while (pBlocks != nullptr)
+            {
+                Block* pNext = pBlocks->pNext;
+                free(pBlocks);
+                pBlocks = pNext;
+            }
+            s_nReserved.fetch_sub(nReserved, memory_order_relaxed);
+            nReserved = 0;
+            pPos = pEnd = nullptr;
+        }
+
+        bool AddBlock(size_t nSize) noexcept
+        {
+            Block* pBlock = static_cast<Block*>(malloc(sizeof(Block) + nSize));
+            if (pBlock == nullptr)
+                return false;
+            if (nReserved == 0 && nHighWater == 0)
+                s_nThreads.fetch_add(1, memory_order_relaxed);
+            pBlock->pNext = pBlocks;
+            pBlock->nSize = nSize;
+            pBlocks = pBlock;
+            pPos = reinterpret_cast<char*>(pBlock + 1);
+            pEnd = pPos + nSize;
+            nReserved += nSize;
+            s_nReserved.fetch_add(nSize, memory_order_relaxed);
+            s_nBlockAllocs.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    };
+    thread_local ThreadArena t_Arena;
+}
+
+void* CSrvArena::Allocate(size_t nSize, size_t nAlign)
+{
+    ThreadArena& Arena = t_Arena;
+    if (nAlign == 0 || (nAlign & (nAlign - 1)) != 0 || nSize > numeric_limits<size_t>::max() - nAlign - sizeof(Block))
+        throw bad_alloc();
+
+    // a new block always fits, its memory is aligned for max_align_t and it has room for the padding
+    for (;;)
+    {
+        const size_t nFree = static_cast<size_t>(Arena.pEnd - Arena.pPos);
+        const size_t nPad = static_cast<size_t>(0 - reinterpret_cast<uintptr_t>(Arena.pPos)) & (nAlign - 1);
+        if (Arena.pPos != nullptr && nPad <= nFree && nSize <= nFree - nPad)
+        {
+            char* pMemory = Arena.pPos + nPad;
+            Arena.pPos = pMemory + nSize;
+            Arena.nUsed += nPad + nSize;
+            return pMemory;
+        }
+        // the rest of the current block is unused until the reset
+        if (Arena.AddBlock(nSize + nAlign > BLOCK_SIZE ? nSize + nAlign : BLOCK_SIZE) == false)
+            throw bad_alloc();
+    }
+}
+
+void CSrvArena::Reset() noexcept
+{
+    ThreadArena& Arena = t_Arena;
+    if (Arena.pBlocks == nullptr)
+        return;
+
+    if (Arena.nUsed > Arena.nHighWater)
+    {
+        Arena.nHighWater = Arena.nUsed;
+        uint64_t nHighWater = s_nHighWater.load(memory_order_relaxed);
+        while (Arena.nUsed > nHighWater && s_nHighWater.compare_exchange_weak(nHighWater, Arena.nUsed, memory_order_relaxed) == false);
+    }
+    s_nResets.fetch_add(1, memory_order_relaxed);
+    Arena.nUsed = 0;
+
+    // several blocks become one, big enough for the next unit of work of the same size
+    if (Arena.pBlocks->pNext != nullptr || Arena.nReserved > MAX_KEEP)
+    {
+        const size_t nSize = Arena.nReserved > MAX_KEEP ? BLOCK_SIZE : Arena.nReserved;
+        Arena.FreeBlocks();
+        if (Arena.AddBlock(nSize) == false)
+            return;
+    }
+    Arena.pPos = reinterpret_cast<char*>(Arena.pBlocks + 1);
+}
+
+size_t CSrvArena::GetUsed() noexcept
+{
+    return t_Arena.nUsed;
+}
+
+void CSrvArena::Enter() noexcept
+{
+    ++t_Arena.nDepth;
+}
+
+void CSrvArena::Leave() noexcept
+{
+    if (--t_Arena.nDepth == 0)
+        Reset();
+}
+
+void CSrvArena::GetStats(StatsList& lstStats)
+{
+    lstStats.emplace_back("high_water_bytes", to_string(s_nHighWater.load(memory_order_relaxed)));
+    lstStats.emplace_back("reserved_bytes", to_string(s_nReserved.load(memory_order_relaxed)));
+    lstStats.emplace_back("block_allocs", to_string(s_nBlockAllocs.load(memory_order_relaxed)));
+    lstStats.emplace_back("resets", to_string(s_nResets.load(memory_order_relaxed)));
+    lstStats.emplace_back("threads", to_string(s_nThreads.load(memory_order_relaxed)));
+}
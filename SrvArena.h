@@ -0,0 +1,102 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVARENA_H
+#define SRVARENA_H
+
+#include "SrvStats.h"
+
+#include <cstddef>
+#include <limits>
+#include <new>
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <memory_resource>
+#endif
+
+// Monotonic per thread memory for the short lived objects of one unit of work: Allocate moves a pointer, there is no
+// free. A CSrvArenaScope frees everything when the outermost scope of the thread ends, the event loop has one around
+// every callback and the task graph around every init and exit task. Memory of the arena must not leave its thread
+// and must not be used after the callback. After a unit of work needing several blocks they are merged into one.
+class CSrvArena
+{
+public:
+    // memory in the arena of the calling thread, throws std::bad_alloc
+    static void* Allocate(std::size_t nSize, std::size_t nAlign = alignof(std::max_align_t));
+    // frees all memory of the calling thread, keeps one block for the next unit of work
+    static void Reset() noexcept;
+    // bytes allocated by the calling thread since the last reset
+    static std::size_t GetUsed() noexcept;
+
+    static void GetStats(StatsList& lstStats);
+
+private:
+    friend class CSrvArenaScope;
+    static void Enter() noexcept;
+    static void Leave() noexcept;
+};
+
+class CSrvArenaScope
+{
+public:
+    CSrvArenaScope() noexcept { CSrvArena::Enter(); }
+    ~CSrvArenaScope() { CSrvArena::Leave(); }
+    CSrvArenaScope(const CSrvArenaScope&) = delete;
+    CSrvArenaScope(CSrvArenaScope&&) = delete;
+    CSrvArenaScope& operator=(const CSrvArenaScope&) = delete;
+    CSrvArenaScope& operator=(CSrvArenaScope&&) = delete;
+};
+
+// for the containers of the standard library, e.g. std::vector<int, CSrvArenaAllocator<int>>
+template<typename T>
+class CSrvArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    CSrvArenaAllocator() noexcept = default;
+    template<typename U>
+    CSrvArenaAllocator(const CSrvArenaAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t nCount)
+    {
+        if (nCount > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_alloc();
+        return static_cast<T*>(CSrvArena::Allocate(nCount * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, std::size_t) noexcept {}
+};
+
+template<typename T, typename U>
+bool operator==(const CSrvArenaAllocator<T>&, const CSrvArenaAllocator<U>&) noexcept { return true; }
+template<typename T, typename U>
+bool operator!=(const CSrvArenaAllocator<T>&, const CSrvArenaAllocator<U>&) noexcept { return false; }
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+// the arena as std::pmr::memory_resource, e.g. std::pmr::vector<int> vValues(CSrvArenaResource::Get())
+class CSrvArenaResource : public std::pmr::memory_resource
+{
+public:
+    static CSrvArenaResource* Get() noexcept
+    {
+        static CSrvArenaResource s_Resource;
+        return &s_Resource;
+    }
+
+private:
+    void* do_allocate(std::size_t nSize, std::size_t nAlign) override { return CSrvArena::Allocate(nSize, nAlign); }
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& Other) const noexcept override { return this == &Other; }
+};
+#endif
+
+#endif // SRVARENA_H
@@ -0,0 +1,219 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvCgroup.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+mutex          CSrvCgroup::s_mxCgroup;
+string         CSrvCgroup::s_strPath;
+vector<string> CSrvCgroup::s_vGroups;
+
+namespace
+{
+    const char* CGROUP_ROOT = "/sys/fs/cgroup";
+
+    bool WriteFile(const string& strFile, const string& strValue)
+    {
+        ofstream fout(strFile);
+        fout << strValue;
+        fout.flush();
+        if (fout.good() == true)
+            return true;
+        syslog(LOG_WARNING, "%s", string("cgroup: cannot write \"" + strValue + "\" to " + strFile).c_str());
+        return false;
+    }
+
+    string ReadFile(const string& strFile)
+    {
+        ifstream fin(strFile);
+        stringstream ss;
+        ss << fin.rdbuf();
+        string strValue = ss.str();
+        strValue.erase(strValue.find_last_not_of('\n') + 1);
+        return strValue;
+    }
+
+    bool MoveThreads(const string& strCgroup, pid_t nPid)
+    {
+        bool bOk = true;
+        DIR* dir = opendir(string("/proc/" + to_string(nPid) + "/task").c_str());
+        if (dir == nullptr)
+            return false;
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != nullptr)
+        {
+            if (ent->d_name[0] != '.')
+                bOk = WriteFile(strCgroup + "/cgroup.threads", ent->d_name) && bOk;
+        }
+        closedir(dir);
+        return bOk;
+    }
+}
+
+bool CSrvCgroup::Setup(const vector<SrvThreadGroup>& vGroups, uint64_t nMemoryHigh)
+{
+    lock_guard<mutex> lock(s_mxCgroup);
+    if (s_strPath.empty() == false)
+        return true;
+
+    const string strOwn = GetOwnPath();
+    if (strOwn.empty() == true)
+    {
+        syslog(LOG_WARNING, "cgroup: no cgroup v2 hierarchy");
+        return false;
+    }
+    const string strPath = strOwn + "/srvlib";
+
+    // the process leaves our own cgroup, only then the controllers can be enabled for the children
+    if ((mkdir(strPath.c_str(), 0755) != 0 && errno != EEXIST)
+        || WriteFile(strPath + "/cgroup.procs", to_string(getpid())) == false)
+        return false;
+
+    // a limit that could not be written is reported, the cgroups are used anyway
+    bool bOk = true;
+    const string strControllers = ReadFile(strOwn + "/cgroup.controllers");
+    string strEnable;
+    for (const char* szController : { "cpu", "memory" })
+    {
+        if (strControllers.find(szController) != string::npos)
+            strEnable += string(strEnable.empty() == true ? "+" : " +") + szController;
+    }
+    if (strEnable.empty() == false)
+        bOk = WriteFile(strOwn + "/cgroup.subtree_control", strEnable) && bOk;
+    if (nMemoryHigh > 0)
+        bOk = WriteFile(strPath + "/memory.high", to_string(nMemoryHigh)) && bOk;
+
+    // the first threaded child makes srvlib the threaded domain, all threads go to main
+    auto fnCreateThreaded = [](const string& strCgroup) -> bool
+    {
+        return (mkdir(strCgroup.c_str(), 0755) == 0 || errno == EEXIST) && WriteFile(strCgroup + "/cgroup.type", "threaded");
+    };
+    if (fnCreateThreaded(strPath + "/main") == false || MoveThreads(strPath + "/main", getpid()) == false)
+        return false;
+    if (vGroups.empty() == false)
+        bOk = WriteFile(strPath + "/cgroup.subtree_control", "+cpu") && bOk;
+
+    for (const SrvThreadGroup& Group : vGroups)
+    {
+        const string strGroup = strPath + "/" + Group.strName;
+        if (Group.strName.empty() == true || Group.strName == "main")
+            continue;
+        if (fnCreateThreaded(strGroup) == false)
+        {
+            bOk = false;
+            continue;
+        }
+        if (Group.nCpuWeight > 0)
+            bOk = WriteFile(strGroup + "/cpu.weight", to_string(Group.nCpuWeight)) && bOk;
+        // cpu.max is "<quota> <period>", the quota in percent of one cpu for a period of 100 ms
+        bOk = WriteFile(strGroup + "/cpu.max", Group.nCpuMaxPercent > 0 ? to_string(Group.nCpuMaxPercent * 1000) + " 100000" : string("max 100000")) && bOk;
+        s_vGroups.push_back(Group.strName);
+    }
+
+    s_strPath = strPath;
+    return bOk;
+}
+
+string CSrvCgroup::GetOwnPath()
+{
+    // the line of cgroup v2 is "0::/system.slice/example.service", with the hybrid layout v2 is mounted on .../unified
+    string strOwn = "\n" + ReadFile("/proc/self/cgroup");
+    const size_t nPos = strOwn.find("\n0::");
+    if (nPos == string::npos)
+        return string();
+    struct stat st;
+    const string strRoot = stat((string(CGROUP_ROOT) + "/cgroup.controllers").c_str(), &st) == 0 ? CGROUP_ROOT : string(CGROUP_ROOT) + "/unified";
+    strOwn = strRoot + strOwn.substr(nPos + 4, strOwn.find('\n', nPos + 1) - nPos - 4);
+    if (strOwn.back() == '/')
+        strOwn.pop_back();
+    return strOwn;
+}
+
+string CSrvCgroup::GetServicePath()
+{
+    {
+        lock_guard<mutex> lock(s_mxCgroup);
+        if (s_strPath.empty() == false)
+            return s_strPath;
+    }
+    return GetOwnPath();
+}
+
+bool CSrvCgroup::JoinThread(const string& strGroup)
+{
+    return MoveThread(strGroup, static_cast<pid_t>(syscall(SYS_gettid)));
+}
+
+bool CSrvCgroup::MoveThread(const string& strGroup, pid_t nTid)
+{
+    lock_guard<mutex> lock(s_mxCgroup);
+    if (s_strPath.empty() == true || (strGroup != "main" && find(s_vGroups.begin(), s_vGroups.end(), strGroup) == s_vGroups.end()))
+        return false;
+    return WriteFile(s_strPath + "/" + strGroup + "/cgroup.threads", to_string(nTid));
+}
+
+bool CSrvCgroup::MoveProcess(const string& strGroup, pid_t nPid)
+{
+    lock_guard<mutex> lock(s_mxCgroup);
+    if (s_strPath.empty() == true || (strGroup != "main" && find(s_vGroups.begin(), s_vGroups.end(), strGroup) == s_vGroups.end()))
+        return false;
+    return MoveThreads(s_strPath + "/" + strGroup, nPid);
+}
+
+void CSrvCgroup::GetStats(StatsList& lstStats)
+{
+    lock_guard<mutex> lock(s_mxCgroup);
+    if (s_strPath.empty() == true)
+        return;
+
+    // files of controllers not enabled for us are missing
+    auto fnAddFile = [&](const string& strKey, const string& strFile)
+    {
+        const string strValue = ReadFile(s_strPath + "/" + strFile);
+        if (strValue.empty() == false)
+            lstStats.emplace_back(strKey, strValue);
+    };
+
+    fnAddFile("memory.current", "memory.current");
+    fnAddFile("memory.high", "memory.high");
+    istringstream ssEvents(ReadFile(s_strPath + "/memory.events"));
+    string strKey, strValue;
+    while (ssEvents >> strKey >> strValue)
+    {
+        if (strKey == "high" || strKey == "oom")
+            lstStats.emplace_back("memory.events." + strKey, strValue);
+    }
+
+    vector<string> vGroups(s_vGroups);
+    vGroups.insert(vGroups.begin(), "main");
+    for (const string& strGroup : vGroups)
+    {
+        istringstream ssStat(ReadFile(s_strPath + "/" + strGroup + "/cpu.stat"));
+        while (ssStat >> strKey >> strValue)
+            lstStats.emplace_back(strGroup + "." + strKey, strValue);
+        fnAddFile(strGroup + ".cpu.weight", strGroup + "/cpu.weight");
+        fnAddFile(strGroup + ".cpu.max", strGroup + "/cpu.max");
+    }
+}
+#endif
@@ -0,0 +1,51 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVCGROUP_H
+#define SRVCGROUP_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "Service.h"
+#include "SrvStats.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Child cgroups (cgroup v2) below the cgroup systemd delegated to us (Delegate=yes)
+//  <own cgroup>/srvlib          the process, memory.high applies to the whole service
+//  <own cgroup>/srvlib/main     threaded, all threads not assigned to a group
+//  <own cgroup>/srvlib/<group>  threaded, cpu.weight and cpu.max of the thread group
+class CSrvCgroup
+{
+public:
+    // false if the cgroups could not be created or a controller or limit could not be written, IsActive tells which
+    static bool Setup(const std::vector<SrvThreadGroup>& vGroups, uint64_t nMemoryHigh);
+    static bool IsActive() noexcept { return s_strPath.empty() == false; }
+    static std::string GetOwnPath();        // cgroup of the calling thread in the v2 hierarchy, empty if there is none
+    static std::string GetServicePath();    // the srvlib cgroup after Setup, otherwise our own cgroup
+
+    static bool JoinThread(const std::string& strGroup);
+    static bool MoveThread(const std::string& strGroup, pid_t nTid);
+    static bool MoveProcess(const std::string& strGroup, pid_t nPid);
+
+    static void GetStats(StatsList& lstStats);
+
+private:
+    static std::mutex               s_mxCgroup;
+    static std::string              s_strPath;
+    static std::vector<std::string> s_vGroups;
+};
+#endif
+
+#endif // SRVCGROUP_H
@@ -0,0 +1,77 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+// Companion tool to control many SrvLib services at once
+// SrvCtl [-d runtime-directory] [-t timeout-ms] [-n process-name] stop|reload|status service|pid ...
+
+#include "SrvFleet.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    const char* szEnv = getenv("RUNTIME_DIRECTORY");
+    string strRunTimeDir = szEnv != nullptr ? szEnv : "/var/run/";
+    string strComm;
+    long lTimeout{10000};
+    int iArg{1};
+
+    for (; iArg < argc && argv[iArg][0] == '-'; ++iArg)
+    {
+        if (argv[iArg][1] == 'd' && iArg + 1 < argc)
+            strRunTimeDir = argv[++iArg];
+        else if (argv[iArg][1] == 't' && iArg + 1 < argc)
+            lTimeout = strtol(argv[++iArg], nullptr, 10);
+        else if (argv[iArg][1] == 'n' && iArg + 1 < argc)
+            strComm = argv[++iArg];
+        else
+            break;
+    }
+
+    if (argc - iArg < 2)
+    {
+        fprintf(stderr, "usage: %s [-d runtime-directory] [-t timeout-ms] [-n process-name] stop|reload|status service|pid ...\n", argv[0]);
+        return 2;
+    }
+
+    const string strCmd = argv[iArg++];
+    FleetCmd Cmd;
+    if (strCmd == "stop")
+        Cmd = FleetCmd::Stop;
+    else if (strCmd == "reload")
+        Cmd = FleetCmd::Reload;
+    else if (strCmd == "status")
+        Cmd = FleetCmd::Status;
+    else
+    {
+        fprintf(stderr, "unknown command: %s\n", strCmd.c_str());
+        return 2;
+    }
+
+    CSrvFleet Fleet(strRunTimeDir, strComm);
+    for (; iArg < argc; ++iArg)
+        Fleet.Add(argv[iArg]);
+
+    int iRet{0};
+    for (const FleetResult& Result : Fleet.Execute(Cmd, chrono::milliseconds(lTimeout)))
+    {
+        printf("%-24s %8d  %-12s %10.3f ms\n", Result.strName.c_str(), static_cast<int>(Result.nPid), Result.strMessage.c_str(), Result.tLatency.count() / 1000.0);
+        if (Result.bOk == false)
+            iRet = 1;
+    }
+
+    return iRet;
+}
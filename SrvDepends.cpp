@@ -0,0 +1,373 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#include "SrvDepends.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+using namespace std;
+
+namespace
+{
+    // a missing path appears by mkdir, bind, a new file or a rename, a watched directory can go away
+    constexpr uint32_t WATCH_MASK = IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+    bool ParsePort(const string& strPort, uint16_t& nPort)
+    {
+        char* pEnd = nullptr;
+        const unsigned long nValue = strtoul(strPort.c_str(), &pEnd, 10);
+        if (strPort.empty() == true || *pEnd != '\0' || nValue == 0 || nValue > 65535)
+            return false;
+        nPort = static_cast<uint16_t>(nValue);
+        return true;
+    }
+
+    string DirName(const string& strPath)
+    {
+        const size_t nSlash = strPath.find_last_of('/');
+        return nSlash == string::npos ? string(".") : (nSlash == 0 ? string("/") : strPath.substr(0, nSlash));
+    }
+}
+
+CSrvDepends::CSrvDepends(CSrvEventLoop& EventLoop) : m_EventLoop(EventLoop), m_fdInotify(-1), m_fdMounts(-1), m_iRetryTimer(-1), m_nMissing(0),
+    m_nWaitedMs(0), m_nEvents(0), m_nConnects(0)
+{
+}
+
+bool CSrvDepends::Parse(const string& strSpec, Dependency& Depend)
+{
+    Depend.strSpec = strSpec;
+    Depend.fdConnect = -1;
+    Depend.bReady = false;
+    Depend.nAddrLen = 0;
+    memset(&Depend.Addr, 0, sizeof(Depend.Addr));
+
+    const size_t nColon = strSpec.find(':');
+    const string strType = nColon == string::npos ? string() : strSpec.substr(0, nColon);
+    const string strValue = nColon == string::npos ? string() : strSpec.substr(nColon + 1);
+    if (strValue.empty() == true)
+        return false;
+
+    if (strType == "file")
+    {
+        Depend.eType = DependType::File;
+        Depend.strPath = strValue;
+        return true;
+    }
+    if (strType == "unix")
+    {
+        // "@name" is a socket in the abstract namespace, it has no path to watch
+        sockaddr_un* pAddr = reinterpret_cast<sockaddr_un*>(&Depend.Addr);
+        if (strValue.size() >= sizeof(pAddr->sun_path))
+            return false;
+        Depend.eType = DependType::Unix;
+        Depend.strPath = strValue[0] == '@' ? string() : strValue;
+        pAddr->sun_family = AF_UNIX;
+        memcpy(pAddr->sun_path, strValue.c_str(), strValue.size());
+        if (strValue[0] == '@')
+            pAddr->sun_path[0] = '\0';
+        Depend.nAddrLen = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + strValue.size() + (strValue[0] == '@' ? 0 : 1));
+        return true;
+    }
+    if (strType == "tcp")
+    {
+        // "port" is a port on 127.0.0.1, "address:port" or "[ipv6 address]:port"
+        Depend.eType = DependType::Tcp;
+        string strHost = "127.0.0.1";
+        string strPort = strValue;
+        const size_t nLast = strValue.find_last_of(':');
+        if (strValue[0] == '[')
+        {
+            const size_t nClose = strValue.find(']');
+            if (nClose == string::npos || nClose + 1 != nLast)
+                return false;
+            strHost = strValue.substr(1, nClose - 1);
+            strPort = strValue.substr(nLast + 1);
+        }
+        else if (nLast != string::npos)
+        {
+            strHost = strValue.substr(0, nLast);
+            strPort = strValue.substr(nLast + 1);
+        }
+
+        uint16_t nPort;
+        if (ParsePort(strPort, nPort) == false)
+            return false;
+        sockaddr_in* pAddr4 = reinterpret_cast<sockaddr_in*>(&Depend.Addr);
+        sockaddr_in6* pAddr6 = reinterpret_cast<sockaddr_in6*>(&Depend.Addr);
+        if (inet_pton(AF_INET, strHost.c_str(), &pAddr4->sin_addr) == 1)
+        {
+            pAddr4->sin_family = AF_INET;
+            pAddr4->sin_port = htons(nPort);
+            Depend.nAddrLen = sizeof(sockaddr_in);
+            return true;
+        }
+        if (inet_pton(AF_INET6, strHost.c_str(), &pAddr6->sin6_addr) == 1)
+        {
+            pAddr6->sin6_family = AF_INET6;
+            pAddr6->sin6_port = htons(nPort);
+            Depend.nAddrLen = sizeof(sockaddr_in6);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CSrvDepends::Start(const vector<string>& vDependencies, chrono::milliseconds tRetry, function<void()> fnReady)
+{
+    unique_lock<mutex> lock(m_mxDepends);
+    if (m_fnReady != nullptr || vDependencies.empty() == true || fnReady == nullptr)
+        return false;
+
+    m_vDepends.clear();
+    bool bPaths = false;
+    bool bSockets = false;
+    for (const string& strSpec : vDependencies)
+    {
+        Dependency Depend;
+        if (Parse(strSpec, Depend) == false)
+        {
+            syslog(LOG_ERR, "dependencies: %s is not file:path, unix:path or tcp:[address:]port", strSpec.c_str());
+            m_vDepends.clear();
+            return false;
+        }
+        bPaths |= Depend.strPath.empty() == false;
+        bSockets |= Depend.eType != DependType::File;
+        m_vDepends.push_back(Depend);
+    }
+
+    if (bPaths == true)
+    {
+        // a mount does not change the directory it covers, the mount table tells it with POLLPRI
+        m_fdInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        m_fdMounts = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+        if (m_fdInotify < 0)
+        {
+            syslog(LOG_ERR, "dependencies: %s", strerror(errno));
+            Release();
+            m_vDepends.clear();
+            return false;
+        }
+    }
+    m_tStart = chrono::steady_clock::now();
+    m_nWaitedMs = 0;
+    m_nEvents = 0;
+    m_nConnects = 0;
+    m_fnReady = fnReady;
+
+    Check(true);
+    if (m_nMissing == 0)
+    {
+        Release();
+        m_fnReady = nullptr;
+        lock.unlock();
+        fnReady();
+        return true;
+    }
+
+    if (m_fdInotify >= 0)
+        m_EventLoop.AddFd(m_fdInotify, EPOLLIN, [this](uint32_t) { Update(false, -1); });
+    if (m_fdMounts >= 0)
+        m_EventLoop.AddFd(m_fdMounts, EPOLLPRI, [this](uint32_t) { Update(false, -1); });
+    // there is no event for a socket starting to listen
+    if (bSockets == true)
+        m_iRetryTimer = m_EventLoop.AddTimer(max(tRetry, chrono::milliseconds(1)), [this]() { Update(true, -1); });
+    return true;
+}
+
+void CSrvDepends::Stop()
+{
+    lock_guard<mutex> lock(m_mxDepends);
+    if (m_fnReady == nullptr)
+        return;
+    Release();
+    m_fnReady = nullptr;
+}
+
+void CSrvDepends::Release()
+{
+    if (m_fnReady != nullptr)
+        m_nWaitedMs = static_cast<uint64_t>(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - m_tStart).count());
+    for (const int fd : { m_fdInotify, m_fdMounts })
+    {
+        if (fd >= 0)
+        {
+            m_EventLoop.RemoveFd(fd);
+            close(fd);
+        }
+    }
+    for (Dependency& Depend : m_vDepends)
+    {
+        if (Depend.fdConnect >= 0)
+        {
+            m_EventLoop.RemoveFd(Depend.fdConnect);
+            close(Depend.fdConnect);
+            Depend.fdConnect = -1;
+        }
+    }
+    if (m_iRetryTimer >= 0)
+        m_EventLoop.RemoveTimer(m_iRetryTimer);
+    m_fdInotify = -1;
+    m_fdMounts = -1;
+    m_iRetryTimer = -1;
+    m_vWatches.clear();     // closed with the inotify fd
+}
+
+void CSrvDepends::Update(bool bSockets, int fdConnected)
+{
+    function<void()> fnReady;
+    {
+        lock_guard<mutex> lock(m_mxDepends);
+        if (m_fnReady == nullptr)
+            return;     // stopped while the event was pending
+
+        // the events are not looked at, every missing path is checked again
+        if (bSockets == false && fdConnected < 0)
+        {
+            ++m_nEvents;
+            alignas(inotify_event) char aBuffer[4096];
+            while (m_fdInotify >= 0 && read(m_fdInotify, aBuffer, sizeof(aBuffer)) > 0);
+        }
+        for (Dependency& Depend : m_vDepends)
+        {
+            if (fdConnected >= 0 && Depend.fdConnect == fdConnected)
+            {
+                int iError = -1;
+                socklen_t nLen = sizeof(iError);
+                getsockopt(fdConnected, SOL_SOCKET, SO_ERROR, &iError, &nLen);
+                m_EventLoop.RemoveFd(fdConnected);
+                close(fdConnected);
+                Depend.fdConnect = -1;
+                if (iError == 0)
+                    Depend.bReady = true;
+            }
+        }
+
+        Check(bSockets);
+        if (m_nMissing > 0)
+            return;
+        Release();
+        fnReady = move(m_fnReady);
+        m_fnReady = nullptr;
+    }
+    fnReady();
+}
+
+void CSrvDepends::Check(bool bSockets)
+{
+    vector<int> vWatches;
+    m_nMissing = 0;
+    for (Dependency& Depend : m_vDepends)
+    {
+        if (Depend.bReady == true)
+            continue;
+
+        // first the watch, then the check: a path created in between is found by the check
+        if (Depend.strPath.empty() == false && m_fdInotify >= 0)
+        {
+            for (string strDir = DirName(Depend.strPath);; strDir = DirName(strDir))
+            {
+                const int iWatch = inotify_add_watch(m_fdInotify, strDir.c_str(), WATCH_MASK);
+                if (iWatch >= 0)
+                {
+                    vWatches.push_back(iWatch);
+                    break;
+                }
+                if (strDir == "/" || strDir == ".")
+                    break;
+            }
+        }
+
+        if (Depend.eType == DependType::File)
+        {
+            struct stat st;
+            Depend.bReady = stat(Depend.strPath.c_str(), &st) == 0;
+        }
+        else if (Depend.eType == DependType::Unix && (bSockets == true || Depend.strPath.empty() == false))
+        {
+            // a datagram socket (/dev/log) refuses a stream with EPROTOTYPE, a full backlog is a listener too
+            const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd >= 0)
+            {
+                ++m_nConnects;
+                Depend.bReady = connect(fd, reinterpret_cast<const sockaddr*>(&Depend.Addr), Depend.nAddrLen) == 0 || errno == EAGAIN || errno == EPROTOTYPE;
+                close(fd);
+            }
+        }
+        else if (Depend.eType == DependType::Tcp && bSockets == true && Depend.fdConnect < 0)
+        {
+            const int fd = socket(Depend.Addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd >= 0)
+            {
+                ++m_nConnects;
+                if (connect(fd, reinterpret_cast<const sockaddr*>(&Depend.Addr), Depend.nAddrLen) == 0)
+                    Depend.bReady = true;
+                else if (errno == EINPROGRESS && m_EventLoop.AddFd(fd, EPOLLOUT, [this, fd](uint32_t) { Update(false, fd); }) == true)
+                {
+                    Depend.fdConnect = fd;
+                    ++m_nMissing;
+                    continue;
+                }
+                close(fd);
+            }
+        }
+
+        if (Depend.bReady == false)
+            ++m_nMissing;
+    }
+
+    // the watches of the directories no longer needed go, inotify returns the same descriptor for a directory
+    sort(vWatches.begin(), vWatches.end());
+    vWatches.erase(unique(vWatches.begin(), vWatches.end()), vWatches.end());
+    for (const int iWatch : m_vWatches)
+    {
+        if (binary_search(vWatches.begin(), vWatches.end(), iWatch) == false)
+            inotify_rm_watch(m_fdInotify, iWatch);
+    }
+    m_vWatches.swap(vWatches);
+}
+
+string CSrvDepends::GetMissing()
+{
+    lock_guard<mutex> lock(m_mxDepends);
+    string strMissing;
+    for (const Dependency& Depend : m_vDepends)
+    {
+        if (Depend.bReady == false)
+            strMissing += (strMissing.empty() == true ? "" : ", ") + Depend.strSpec;
+    }
+    return strMissing;
+}
+
+void CSrvDepends::GetStats(StatsList& lstStats)
+{
+    lock_guard<mutex> lock(m_mxDepends);
+    const uint64_t nWaitedMs = m_fnReady != nullptr ? static_cast<uint64_t>(chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - m_tStart).count()) : m_nWaitedMs;
+    lstStats.emplace_back("dependencies", to_string(m_vDepends.size()));
+    lstStats.emplace_back("missing", to_string(m_nMissing));
+    lstStats.emplace_back("waited_ms", to_string(nWaitedMs));
+    lstStats.emplace_back("events", to_string(m_nEvents));
+    lstStats.emplace_back("connects", to_string(m_nConnects));
+}
@@ -0,0 +1,88 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVDEPENDS_H
+#define SRVDEPENDS_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvEventLoop.h"
+#include "SrvStats.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+// Waits for what the service needs before it can start: "file:/path" (a pid file of a peer, a file on a mounted file
+// system), "unix:/path" (a socket accepting connections) and "tcp:port", "tcp:127.0.0.1:port" or "tcp:[::1]:port".
+// The deepest existing directory of a path is watched with inotify and the mount table with poll, so a path is seen
+// the moment it is there. A socket refusing the connection and a port are tried again every tRetry. fnReady is called
+// once, when all are there, in Start or in the event loop thread.
+class CSrvDepends
+{
+public:
+    explicit CSrvDepends(CSrvEventLoop& EventLoop);
+    ~CSrvDepends() { Stop(); }
+    CSrvDepends() = delete;
+    CSrvDepends(const CSrvDepends&) = delete;
+    CSrvDepends(CSrvDepends&&) = delete;
+    CSrvDepends& operator=(const CSrvDepends&) = delete;
+    CSrvDepends& operator=(CSrvDepends&&) = delete;
+
+    // false if a dependency cannot be parsed or the watch cannot be set up
+    bool Start(const std::vector<std::string>& vDependencies, std::chrono::milliseconds tRetry, std::function<void()> fnReady);
+    void Stop();
+    // the dependencies not there yet, separated by ", "
+    std::string GetMissing();
+    void GetStats(StatsList& lstStats);
+
+private:
+    enum class DependType : int { File, Unix, Tcp };
+
+    struct Dependency
+    {
+        std::string strSpec;
+        DependType  eType;
+        std::string strPath;
+        sockaddr_storage Addr;
+        socklen_t   nAddrLen;
+        int         fdConnect;      // tcp connect in progress
+        bool        bReady;
+    };
+
+    static bool Parse(const std::string& strSpec, Dependency& Depend);
+    void Update(bool bSockets, int fdConnected);
+    void Check(bool bSockets);
+    void Release();
+
+private:
+    CSrvEventLoop&          m_EventLoop;
+    std::mutex              m_mxDepends;
+    std::vector<Dependency> m_vDepends;
+    std::vector<int>        m_vWatches;
+    std::function<void()>   m_fnReady;
+    int                     m_fdInotify;
+    int                     m_fdMounts;
+    int                     m_iRetryTimer;
+    size_t                  m_nMissing;
+    std::chrono::steady_clock::time_point m_tStart;
+    uint64_t                m_nWaitedMs;
+    uint64_t                m_nEvents;
+    uint64_t                m_nConnects;
+};
+#endif
+
+#endif // SRVDEPENDS_H
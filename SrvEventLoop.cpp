@@ -0,0 +1,291 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvEventLoop.h"
+#include "SrvWatchdog.h"
+#include "SrvArena.h"
+
+#include <future>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+using namespace std;
+
+namespace
+{
+    constexpr uint64_t KEY_TIMER  = 1ull << 32;     // epoll keys of our timers, the lower 32 bit are the timerfd
+    constexpr uint64_t KEY_WAKEUP = 2ull << 32;
+}
+
+CSrvEventLoop::CSrvEventLoop() : m_fdEpoll(epoll_create1(EPOLL_CLOEXEC)), m_fdWakeup(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), m_bStop(false), m_bRunning(false), m_nPendingSignals(0)
+{
+    if (m_fdEpoll >= 0 && m_fdWakeup >= 0)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = KEY_WAKEUP;
+        epoll_ctl(m_fdEpoll, EPOLL_CTL_ADD, m_fdWakeup, &ev);
+    }
+}
+
+CSrvEventLoop::~CSrvEventLoop()
+{
+    Stop();
+
+    lock_guard<mutex> lock(m_mxCallBacks);
+    for (auto& itFd : m_mapFds)
+    {
+        if ((itFd.first & KEY_TIMER) != 0)  // the timerfd is our own
+            close(static_cast<int>(itFd.first & 0xffffffff));
+    }
+    if (m_fdWakeup >= 0)
+        close(m_fdWakeup);
+    if (m_fdEpoll >= 0)
+        close(m_fdEpoll);
+}
+
+bool CSrvEventLoop::Start()
+{
+    if (m_fdEpoll < 0 || m_fdWakeup < 0)
+        return false;
+    if (m_thLoop.joinable() == true)
+        return true;
+
+    m_bStop = false;
+    {
+        lock_guard<mutex> lock(m_mxCallBacks);
+        m_bRunning = true;
+    }
+    m_thLoop = thread(&CSrvEventLoop::Run, this);
+    return true;
+}
+
+void CSrvEventLoop::Stop()
+{
+    if (m_thLoop.joinable() == false)
+        return;
+
+    m_bStop = true;
+    Wakeup();
+    if (IsLoopThread() == true)
+        m_thLoop.detach();
+    else
+        m_thLoop.join();
+}
+
+bool CSrvEventLoop::AddFd(int fd, uint32_t nEvents, function<void(uint32_t)> fnCallBack)
+{
+    if (fd < 0 || m_fdEpoll < 0)
+        return false;
+
+    lock_guard<mutex> lock(m_mxCallBacks);
+    epoll_event ev{};
+    ev.events = nEvents;
+    ev.data.u64 = static_cast<uint64_t>(fd);
+    const int iOp = m_mapFds.find(static_cast<uint64_t>(fd)) == m_mapFds.end() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(m_fdEpoll, iOp, fd, &ev) != 0)
+        return false;
+    m_mapFds[static_cast<uint64_t>(fd)] = make_shared<function<void(uint32_t)>>(move(fnCallBack));
+    return true;
+}
+
+void CSrvEventLoop::RemoveFd(int fd)
+{
+    lock_guard<mutex> lock(m_mxCallBacks);
+    if (m_mapFds.erase(static_cast<uint64_t>(fd)) > 0)
+        epoll_ctl(m_fdEpoll, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+int CSrvEventLoop::AddTimer(chrono::milliseconds tInterval, function<void()> fnCallBack, bool bRepeat)
+{
+    const int fdTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fdTimer < 0)
+        return -1;
+
+    itimerspec its{};
+    const long long nMs = tInterval.count() > 0 ? tInterval.count() : 1;
+    its.it_value.tv_sec = static_cast<time_t>(nMs / 1000);
+    its.it_value.tv_nsec = static_cast<long>((nMs % 1000) * 1000000);
+    if (bRepeat == true)
+        its.it_interval = its.it_value;
+    timerfd_settime(fdTimer, 0, &its, nullptr);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = KEY_TIMER | static_cast<uint64_t>(fdTimer);
+    lock_guard<mutex> lock(m_mxCallBacks);
+    if (epoll_ctl(m_fdEpoll, EPOLL_CTL_ADD, fdTimer, &ev) != 0)
+    {
+        close(fdTimer);
+        return -1;
+    }
+    m_mapFds[KEY_TIMER | static_cast<uint64_t>(fdTimer)] = make_shared<function<void(uint32_t)>>([this, fdTimer, bRepeat, fnCallBack](uint32_t)
+    {
+        uint64_t nExpired;
+        if (read(fdTimer, &nExpired, sizeof(nExpired)) != sizeof(nExpired))
+            return;
+        fnCallBack();
+        if (bRepeat == false)
+            RemoveTimer(fdTimer);
+    });
+    return fdTimer;
+}
+
+void CSrvEventLoop::RemoveTimer(int iTimerId)
+{
+    if (iTimerId < 0)
+        return;
+
+    lock_guard<mutex> lock(m_mxCallBacks);
+    if (m_mapFds.erase(KEY_TIMER | static_cast<uint64_t>(iTimerId)) > 0)
+    {
+        epoll_ctl(m_fdEpoll, EPOLL_CTL_DEL, iTimerId, nullptr);
+        close(iTimerId);
+    }
+}
+
+void CSrvEventLoop::Post(function<void()> fnCallBack)
+{
+    {
+        lock_guard<mutex> lock(m_mxCallBacks);
+        m_dqPosted.emplace_back(move(fnCallBack));
+    }
+    Wakeup();
+}
+
+void CSrvEventLoop::Invoke(function<void()> fnCallBack)
+{
+    promise<void> Done;
+    future<void> Finished = Done.get_future();
+    bool bPosted = false;
+    {
+        lock_guard<mutex> lock(m_mxCallBacks);
+        if (m_bRunning == true && IsLoopThread() == false)
+        {
+            m_dqPosted.emplace_back([&]() { fnCallBack(); Done.set_value(); });
+            bPosted = true;
+        }
+    }
+    if (bPosted == false)
+    {
+        fnCallBack();
+        return;
+    }
+    Wakeup();
+    Finished.wait();
+}
+
+void CSrvEventLoop::PostSignal(int iSignal) noexcept
+{
+    if (iSignal <= 0 || iSignal >= 64)
+        return;
+    m_nPendingSignals.fetch_or(1ull << iSignal);
+    Wakeup();
+}
+
+void CSrvEventLoop::OnSignal(int iSignal, function<void()> fnCallBack)
+{
+    lock_guard<mutex> lock(m_mxCallBacks);
+    m_mapSignals[iSignal] = move(fnCallBack);
+}
+
+void CSrvEventLoop::Wakeup() noexcept
+{
+    const uint64_t nOne = 1;
+    if (write(m_fdWakeup, &nOne, sizeof(nOne)) < 0)
+        return;     // Counter is already full, the loop will wake up anyway
+}
+
+void CSrvEventLoop::Run()
+{
+    epoll_event aEvents[16];
+    CSrvWatchdog::RegisterThread("EventLoop");
+
+    while (m_bStop == false)
+    {
+        const int iCount = epoll_wait(m_fdEpoll, aEvents, 16, -1);
+        for (int n = 0; n < iCount; ++n)
+        {
+            if (aEvents[n].data.u64 == KEY_WAKEUP)
+            {
+                uint64_t nValue;
+                if (read(m_fdWakeup, &nValue, sizeof(nValue)) < 0)
+                    continue;
+
+                const uint64_t nSignals = m_nPendingSignals.exchange(0);
+                for (int iSignal = 1; iSignal < 64; ++iSignal)
+                {
+                    if ((nSignals & (1ull << iSignal)) == 0)
+                        continue;
+                    function<void()> fnCallBack;
+                    {
+                        lock_guard<mutex> lock(m_mxCallBacks);
+                        auto itSignal = m_mapSignals.find(iSignal);
+                        if (itSignal != m_mapSignals.end())
+                            fnCallBack = itSignal->second;
+                    }
+                    if (fnCallBack != nullptr)
+                    {
+                        CSrvArenaScope ArenaScope;
+                        CSrvWatchdog::BeginWork();
+                        fnCallBack();
+                        CSrvWatchdog::EndWork();
+                    }
+                }
+
+                deque<function<void()>> dqPosted;
+                {
+                    lock_guard<mutex> lock(m_mxCallBacks);
+                    dqPosted.swap(m_dqPosted);
+                }
+                for (auto& fnCallBack : dqPosted)
+                {
+                    CSrvArenaScope ArenaScope;
+                    CSrvWatchdog::BeginWork();
+                    fnCallBack();
+                    CSrvWatchdog::EndWork();
+                }
+                continue;
+            }
+
+            shared_ptr<function<void(uint32_t)>> pCallBack;
+            {
+                lock_guard<mutex> lock(m_mxCallBacks);
+                auto itFd = m_mapFds.find(aEvents[n].data.u64);
+                if (itFd != m_mapFds.end())
+                    pCallBack = itFd->second;
+            }
+            if (pCallBack != nullptr)
+            {
+                CSrvArenaScope ArenaScope;  // every callback is a unit of work
+                CSrvWatchdog::BeginWork();
+                (*pCallBack)(aEvents[n].events);
+                CSrvWatchdog::EndWork();
+            }
+        }
+    }
+
+    // what was posted while stopping still runs, Invoke waits for it
+    deque<function<void()>> dqPosted;
+    {
+        lock_guard<mutex> lock(m_mxCallBacks);
+        m_bRunning = false;
+        dqPosted.swap(m_dqPosted);
+    }
+    for (auto& fnCallBack : dqPosted)
+        fnCallBack();
+    CSrvWatchdog::UnregisterThread();
+}
+#endif
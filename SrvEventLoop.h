@@ -0,0 +1,75 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVEVENTLOOP_H
+#define SRVEVENTLOOP_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// epoll based loop running in its own thread, all callbacks are called in this thread
+class CSrvEventLoop
+{
+public:
+    CSrvEventLoop();
+    ~CSrvEventLoop();
+    CSrvEventLoop(const CSrvEventLoop&) = delete;
+    CSrvEventLoop(CSrvEventLoop&&) = delete;
+    CSrvEventLoop& operator=(const CSrvEventLoop&) = delete;
+    CSrvEventLoop& operator=(CSrvEventLoop&&) = delete;
+
+    bool Start();
+    void Stop();
+    bool IsLoopThread() const noexcept { return m_thLoop.get_id() == std::this_thread::get_id(); }
+
+    bool AddFd(int fd, uint32_t nEvents, std::function<void(uint32_t)> fnCallBack);
+    void RemoveFd(int fd);
+
+    // returns a timer id >= 0, or -1 on error
+    int  AddTimer(std::chrono::milliseconds tInterval, std::function<void()> fnCallBack, bool bRepeat = true);
+    void RemoveTimer(int iTimerId);
+
+    void Post(std::function<void()> fnCallBack);
+    // Calls fnCallBack in the loop thread and waits for it, directly when the loop does not run or in the loop thread
+    void Invoke(std::function<void()> fnCallBack);
+
+    // Async signal safe, the handler registered with OnSignal is called in the loop thread
+    void PostSignal(int iSignal) noexcept;
+    void OnSignal(int iSignal, std::function<void()> fnCallBack);
+
+private:
+    void Run();
+    void Wakeup() noexcept;
+
+private:
+    int                   m_fdEpoll;
+    int                   m_fdWakeup;
+    std::atomic<bool>     m_bStop;
+    bool                  m_bRunning;
+    std::atomic<uint64_t> m_nPendingSignals;
+    std::thread           m_thLoop;
+    std::mutex            m_mxCallBacks;
+    std::map<uint64_t, std::shared_ptr<std::function<void(uint32_t)>>> m_mapFds;
+    std::map<int, std::function<void()>> m_mapSignals;
+    std::deque<std::function<void()>>    m_dqPosted;
+};
+#endif
+
+#endif // SRVEVENTLOOP_H
@@ -0,0 +1,161 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvFdStore.h"
+#include "SrvNotify.h"
+
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace
+{
+    constexpr int LISTEN_FDS_START = 3;
+
+    mutex& GetMutex()
+    {
+        static mutex mxStore;
+        return mxStore;
+    }
+
+    multimap<string, int>& GetInherited()
+    {
+        static multimap<string, int> mapInherited;
+        return mapInherited;
+    }
+
+    bool IsValidName(const string& strName)
+    {
+        if (strName.empty() == true || strName.size() > 255)
+            return false;
+        for (const char c : strName)
+        {
+            if (c == ':' || static_cast<unsigned char>(c) < 0x20 || c == 0x7f)
+                return false;
+        }
+        return true;
+    }
+}
+
+void CSrvFdStore::Init()
+{
+    static once_flag s_Once;
+    call_once(s_Once, []()
+    {
+        const char* szPid = getenv("LISTEN_PID");
+        const char* szFds = getenv("LISTEN_FDS");
+        if (szPid == nullptr || szFds == nullptr || strtol(szPid, nullptr, 10) != getpid())
+            return;
+
+        const long nFds = strtol(szFds, nullptr, 10);
+        const char* szNames = getenv("LISTEN_FDNAMES");
+        string strNames = szNames != nullptr ? szNames : "";
+
+        lock_guard<mutex> lock(GetMutex());
+        size_t nPos = 0;
+        for (long n = 0; n < nFds; ++n)
+        {
+            string strName;
+            if (nPos <= strNames.size())
+            {
+                const size_t nEnd = strNames.find(':', nPos);
+                strName = strNames.substr(nPos, nEnd == string::npos ? string::npos : nEnd - nPos);
+                nPos = nEnd == string::npos ? strNames.size() + 1 : nEnd + 1;
+            }
+            if (strName.empty() == true)
+                strName = "unknown";
+            const int fd = LISTEN_FDS_START + static_cast<int>(n);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            GetInherited().emplace(strName, fd);
+        }
+
+        // the fds are ours, child processes must not take them
+        unsetenv("LISTEN_PID");
+        unsetenv("LISTEN_FDS");
+        unsetenv("LISTEN_FDNAMES");
+    });
+}
+
+int CSrvFdStore::Take(const string& strName)
+{
+    Init();
+    lock_guard<mutex> lock(GetMutex());
+    auto itFd = GetInherited().find(strName);
+    if (itFd == GetInherited().end())
+        return -1;
+    const int fd = itFd->second;
+    GetInherited().erase(itFd);
+    return fd;
+}
+
+vector<string> CSrvFdStore::GetNames()
+{
+    Init();
+    lock_guard<mutex> lock(GetMutex());
+    vector<string> vNames;
+    for (const auto& itFd : GetInherited())
+        vNames.push_back(itFd.first);
+    return vNames;
+}
+
+bool CSrvFdStore::Store(const string& strName, int fd)
+{
+    if (fd < 0 || IsValidName(strName) == false)
+        return false;
+    return CSrvNotify::Notify("FDSTORE=1\nFDNAME=" + strName, { fd });
+}
+
+bool CSrvFdStore::Remove(const string& strName)
+{
+    if (IsValidName(strName) == false)
+        return false;
+    return CSrvNotify::Notify("FDSTOREREMOVE=1\nFDNAME=" + strName);
+}
+
+int CSrvFdStore::CreateMemFd(const string& strName, size_t nSize)
+{
+    const int fd = memfd_create(strName.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, static_cast<off_t>(nSize)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void* CSrvFdStore::Map(int fd, size_t& nSize)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        return nullptr;
+    nSize = static_cast<size_t>(st.st_size);
+
+    const int iSeals = fcntl(fd, F_GET_SEALS);
+    const int iProt = iSeals >= 0 && (iSeals & F_SEAL_WRITE) != 0 ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* pData = mmap(nullptr, nSize, iProt, MAP_SHARED, fd, 0);
+    return pData != MAP_FAILED ? pData : nullptr;
+}
+
+bool CSrvFdStore::Seal(int fd)
+{
+    return fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0;
+}
+#endif
@@ -0,0 +1,43 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVFDSTORE_H
+#define SRVFDSTORE_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Keeps fds (listeners, memfds with the cache state) in the systemd fd store over a restart or a crash of the service.
+// Needs FileDescriptorStoreMax= and NotifyAccess= in the unit file. The fds of the previous instance are passed
+// by systemd in LISTEN_FDS / LISTEN_FDNAMES, ServiceMain takes them before it forks.
+class CSrvFdStore
+{
+public:
+    static void Init();
+    // the fd stored under this name by the previous instance, the caller owns it, -1 if there is none
+    static int  Take(const std::string& strName);
+    static std::vector<std::string> GetNames();
+    // the fd stays open in this process, systemd holds a duplicate
+    static bool Store(const std::string& strName, int fd);
+    static bool Remove(const std::string& strName);
+
+    // memfd for the state, Map maps all of it shared (read only if it is sealed) and returns the size in nSize
+    static int   CreateMemFd(const std::string& strName, size_t nSize);
+    static void* Map(int fd, size_t& nSize);
+    // no more writes or size changes, the next instance can trust the content. Writable mappings must be unmapped first
+    static bool  Seal(int fd);
+};
+#endif
+
+#endif // SRVFDSTORE_H
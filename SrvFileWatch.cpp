@@ -0,0 +1,188 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#include "SrvFileWatch.h"
+#include "SrvTrace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/timerfd.h>
+
+using namespace std;
+
+namespace
+{
+    // written in place (IN_CLOSE_WRITE), replaced by rename (IN_MOVED_TO), deleted and created again. A symlink
+    // switched by renaming the link or a directory next to it (kubernetes ConfigMap) is a IN_MOVED_TO too.
+    constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ATTRIB | IN_ONLYDIR;
+
+    bool Differs(const struct stat& st1, const struct stat& st2)
+    {
+        return st1.st_dev != st2.st_dev || st1.st_ino != st2.st_ino || st1.st_size != st2.st_size
+            || st1.st_mtim.tv_sec != st2.st_mtim.tv_sec || st1.st_mtim.tv_nsec != st2.st_mtim.tv_nsec
+            || st1.st_ctim.tv_sec != st2.st_ctim.tv_sec || st1.st_ctim.tv_nsec != st2.st_ctim.tv_nsec;
+    }
+}
+
+CSrvFileWatch::CSrvFileWatch(CSrvEventLoop& EventLoop) : m_EventLoop(EventLoop), m_fdInotify(-1), m_fdTimer(-1), m_nEvents(0), m_nChanges(0)
+{
+}
+
+bool CSrvFileWatch::Start(const vector<string>& vFiles, chrono::milliseconds tDebounce, function<void()> fnChanged)
+{
+    if (m_fdInotify >= 0 || vFiles.empty() == true)
+        return false;
+
+    m_fdInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_fdTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_fdInotify < 0 || m_fdTimer < 0)
+    {
+        syslog(LOG_WARNING, "file watch: %s", strerror(errno));
+        Stop();
+        return false;
+    }
+    m_tDebounce = max(tDebounce, chrono::milliseconds(1));
+    m_fnChanged = fnChanged;
+
+    for (const string& strFile : vFiles)
+    {
+        WatchedFile File{};
+        File.strPath = strFile;
+        const size_t nSlash = strFile.find_last_of('/');
+        File.strDir = nSlash == string::npos ? string(".") : (nSlash == 0 ? string("/") : strFile.substr(0, nSlash));
+        File.strName = nSlash == string::npos ? strFile : strFile.substr(nSlash + 1);
+        File.bExists = stat(strFile.c_str(), &File.st) == 0;
+
+        // several files in one directory share the watch, inotify returns the same descriptor
+        const int iWatch = inotify_add_watch(m_fdInotify, File.strDir.c_str(), WATCH_MASK);
+        if (iWatch < 0)
+        {
+            syslog(LOG_WARNING, "file watch: cannot watch %s: %s", File.strDir.c_str(), strerror(errno));
+            continue;
+        }
+        if (find(m_vWatches.begin(), m_vWatches.end(), iWatch) == m_vWatches.end())
+            m_vWatches.push_back(iWatch);
+        m_vFiles.push_back(File);
+    }
+    if (m_vFiles.empty() == true)
+    {
+        Stop();
+        return false;
+    }
+
+    m_EventLoop.AddFd(m_fdInotify, EPOLLIN, [this](uint32_t) { OnEvents(); });
+    m_EventLoop.AddFd(m_fdTimer, EPOLLIN, [this](uint32_t) { OnDebounce(); });
+    return true;
+}
+
+void CSrvFileWatch::Stop()
+{
+    // the callbacks use the descriptors and the files, they are released in the loop thread between two callbacks
+    m_EventLoop.Invoke([this]()
+    {
+        for (const int fd : { m_fdInotify, m_fdTimer })
+        {
+            if (fd >= 0)
+            {
+                m_EventLoop.RemoveFd(fd);
+                close(fd);
+            }
+        }
+        m_fdInotify = -1;
+        m_fdTimer = -1;
+        m_vFiles.clear();
+        m_vWatches.clear();
+        m_fnChanged = nullptr;
+    });
+}
+
+void CSrvFileWatch::OnEvents()
+{
+    // only the names are looked at, the files are compared when the burst is over
+    alignas(inotify_event) char aBuffer[4096];
+    bool bRelevant = false;
+    ssize_t nRead;
+    while ((nRead = read(m_fdInotify, aBuffer, sizeof(aBuffer))) > 0)
+    {
+        for (char* pPos = aBuffer; pPos < aBuffer + nRead;)
+        {
+            const inotify_event* pEvent = reinterpret_cast<const inotify_event*>(pPos);
+            pPos += sizeof(inotify_event) + pEvent->len;
+            if ((pEvent->mask & IN_Q_OVERFLOW) != 0)
+                bRelevant = true;
+            if ((pEvent->mask & IN_IGNORED) != 0)
+            {
+                syslog(LOG_WARNING, "file watch: a watched directory was removed");
+                continue;
+            }
+            // a file of its own or a name starting with "." (the temporary files of rename and of ConfigMap updates)
+            for (const WatchedFile& File : m_vFiles)
+            {
+                if (pEvent->len > 0 && (File.strName == pEvent->name || pEvent->name[0] == '.'))
+                    bRelevant = true;
+            }
+        }
+    }
+    if (bRelevant == false)
+        return;
+    ++m_nEvents;
+
+    // every event moves the end of the burst
+    itimerspec its{};
+    its.it_value.tv_sec = static_cast<time_t>(m_tDebounce.count() / 1000);
+    its.it_value.tv_nsec = static_cast<long>((m_tDebounce.count() % 1000) * 1000000);
+    timerfd_settime(m_fdTimer, 0, &its, nullptr);
+}
+
+void CSrvFileWatch::OnDebounce()
+{
+    uint64_t nExpired;
+    if (read(m_fdTimer, &nExpired, sizeof(nExpired)) != sizeof(nExpired))
+        return;
+
+    vector<struct stat> vStats(m_vFiles.size());
+    vector<bool> vExists(m_vFiles.size());
+    bool bChanged = false;
+    for (size_t n = 0; n < m_vFiles.size(); ++n)
+    {
+        const WatchedFile& File = m_vFiles[n];
+        const bool bExists = stat(File.strPath.c_str(), &vStats[n]) == 0;
+        vExists[n] = bExists;
+        if (bExists == false && File.bExists == true)
+            return;     // deleted and not yet written again, wait for the next event
+        if (bExists == true && (File.bExists == false || Differs(vStats[n], File.st) == true))
+            bChanged = true;
+    }
+    if (bChanged == false)
+        return;
+    for (size_t n = 0; n < m_vFiles.size(); ++n)
+    {
+        m_vFiles[n].bExists = vExists[n];
+        m_vFiles[n].st = vStats[n];
+    }
+
+    ++m_nChanges;
+    SRVTRACE_SCOPE("FileWatchCallBack");
+    if (m_fnChanged != nullptr)
+        m_fnChanged();
+}
+
+void CSrvFileWatch::GetStats(StatsList& lstStats)
+{
+    lstStats.emplace_back("events", to_string(m_nEvents));
+    lstStats.emplace_back("reloads", to_string(m_nChanges));
+}
@@ -0,0 +1,74 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVFILEWATCH_H
+#define SRVFILEWATCH_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvEventLoop.h"
+#include "SrvStats.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+// Watches files with inotify and calls fnChanged in the event loop thread when one of them has changed. The directory
+// of a file is watched, not the file, so an editor or a deployment replacing it with rename is seen too. A burst
+// of events is merged: fnChanged is called when there was no event for tDebounce, and only if a file is different.
+class CSrvFileWatch
+{
+public:
+    explicit CSrvFileWatch(CSrvEventLoop& EventLoop);
+    ~CSrvFileWatch() { Stop(); }
+    CSrvFileWatch() = delete;
+    CSrvFileWatch(const CSrvFileWatch&) = delete;
+    CSrvFileWatch(CSrvFileWatch&&) = delete;
+    CSrvFileWatch& operator=(const CSrvFileWatch&) = delete;
+    CSrvFileWatch& operator=(CSrvFileWatch&&) = delete;
+
+    bool Start(const std::vector<std::string>& vFiles, std::chrono::milliseconds tDebounce, std::function<void()> fnChanged);
+    void Stop();
+    bool IsActive() const noexcept { return m_fdInotify >= 0; }
+    void GetStats(StatsList& lstStats);
+
+private:
+    struct WatchedFile
+    {
+        std::string strPath;
+        std::string strDir;
+        std::string strName;
+        struct stat st;
+        bool bExists;
+    };
+
+    void OnEvents();
+    void OnDebounce();
+
+private:
+    CSrvEventLoop&           m_EventLoop;
+    int                      m_fdInotify;
+    int                      m_fdTimer;
+    std::chrono::milliseconds m_tDebounce;
+    std::function<void()>    m_fnChanged;
+    std::vector<WatchedFile> m_vFiles;
+    std::vector<int>         m_vWatches;
+    std::atomic<uint64_t>    m_nEvents;
+    std::atomic<uint64_t>    m_nChanges;
+};
+#endif
+
+#endif // SRVFILEWATCH_H
@@ -0,0 +1,217 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvFleet.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+using namespace std;
+
+namespace
+{
+    string ReadComm(const string& strPid)
+    {
+        ifstream fin("/proc/" + strPid + "/comm");
+        string strName;
+        getline(fin, strName);
+        return strName;
+    }
+}
+
+CSrvFleet::CSrvFleet(const string& strRunTimeDir, const string& strComm) : m_strRunTimeDir(strRunTimeDir), m_strComm(strComm)
+{
+}
+
+pid_t CSrvFleet::FindPid(const string& strService) const
+{
+    if (strService.empty() == true)
+        return 0;
+
+    if (strService.find_first_not_of("0123456789") == string::npos)
+    {
+        errno = 0;
+        const long lPid = strtol(strService.c_str(), nullptr, 10);
+        return errno == 0 && lPid > 0 && lPid <= numeric_limits<pid_t>::max() ? static_cast<pid_t>(lPid) : 0;
+    }
+
+    // the process name in /proc/<pid>/comm has at most 15 characters
+    const string strComm = (m_strComm.empty() == true ? strService : m_strComm).substr(0, 15);
+
+    // the pid file as written by ServiceMain, directly in the runtime directory or in a sub directory with the service name.
+    // A pid file left by a crash may name a pid reused by another process, so the process name must match.
+    for (const string& strPidFile : { m_strRunTimeDir + "/" + strService + ".pid", m_strRunTimeDir + "/" + strService + "/" + strService + ".pid" })
+    {
+        ifstream fin(strPidFile);
+        long lPid{0};
+        if (fin >> lPid && lPid > 0 && lPid <= numeric_limits<pid_t>::max() && ReadComm(to_string(lPid)) == strComm)
+            return static_cast<pid_t>(lPid);
+    }
+
+    pid_t nFound{0};
+    DIR* dir = opendir("/proc");
+    if (dir != nullptr)
+    {
+        struct dirent* ent;
+        char* endptr;
+        while (nFound == 0 && (ent = readdir(dir)) != nullptr)
+        {
+            const long lPid = strtol(ent->d_name, &endptr, 10);
+            if (*endptr != '\0' || static_cast<pid_t>(lPid) == getpid())
+                continue;
+
+            if (ReadComm(ent->d_name) == strComm)
+            {
+                // skip processes that already ended (zombie), like the parent of a forking daemon
+                ifstream finStat(string("/proc/") + ent->d_name + "/stat");
+                string strStat;
+                getline(finStat, strStat);
+                const size_t nPos = strStat.rfind(')');
+                if (nPos == string::npos || strStat.size() < nPos + 3 || strStat[nPos + 2] != 'Z')
+                    nFound = static_cast<pid_t>(lPid);
+            }
+        }
+        closedir(dir);
+    }
+    return nFound;
+}
+
+int CSrvFleet::OpenPid(pid_t nPid) noexcept
+{
+    return static_cast<int>(syscall(SYS_pidfd_open, nPid, 0));
+}
+
+int CSrvFleet::WaitForExit(pid_t nPid, chrono::milliseconds tTimeout) noexcept
+{
+    const int fdPid = OpenPid(nPid);
+    if (fdPid < 0)
+        return errno == ESRCH ? 1 : -1;
+
+    const int fdEpoll = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    int iRet{-1};
+    if (fdEpoll >= 0 && epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fdPid, &ev) == 0)
+    {
+        const auto tEnd = chrono::steady_clock::now() + tTimeout;
+        do
+        {
+            const long long nWait = tTimeout.count() < 0 ? -1 : max(0LL, static_cast<long long>(chrono::duration_cast<chrono::milliseconds>(tEnd - chrono::steady_clock::now()).count()));
+            iRet = epoll_wait(fdEpoll, &ev, 1, static_cast<int>(nWait));
+        } while (iRet < 0 && errno == EINTR);
+        iRet = iRet > 0 ? 1 : 0;
+    }
+    if (fdEpoll >= 0)
+        close(fdEpoll);
+    close(fdPid);
+    return iRet;
+}
+
+vector<FleetResult> CSrvFleet::Execute(FleetCmd Cmd, chrono::milliseconds tTimeout)
+{
+    const int iSignal = Cmd == FleetCmd::Stop ? SIGQUIT : (Cmd == FleetCmd::Reload ? SIGHUP : 0);
+    vector<FleetResult> vResult;
+    vector<int> vPidFd(m_vServices.size(), -1);
+    vector<chrono::steady_clock::time_point> vSent(m_vServices.size());
+    size_t nPending{0};
+
+    const int fdEpoll = epoll_create1(EPOLL_CLOEXEC);
+
+    for (size_t n = 0; n < m_vServices.size(); ++n)
+    {
+        vResult.push_back({ m_vServices[n], FindPid(m_vServices[n]), false, "", chrono::microseconds(0) });
+        FleetResult& Result = vResult.back();
+        if (Result.nPid <= 0)
+        {
+            Result.strMessage = "not running";
+            continue;
+        }
+
+        vPidFd[n] = OpenPid(Result.nPid);
+        vSent[n] = chrono::steady_clock::now();
+        const long lRes = vPidFd[n] >= 0 ? syscall(SYS_pidfd_send_signal, vPidFd[n], iSignal, nullptr, 0) : kill(Result.nPid, iSignal);
+        if (lRes != 0)
+        {
+            Result.strMessage = errno == ESRCH ? "not running" : strerror(errno);
+            continue;
+        }
+
+        if (Cmd == FleetCmd::Stop && vPidFd[n] >= 0 && fdEpoll >= 0)
+        {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = n;
+            if (epoll_ctl(fdEpoll, EPOLL_CTL_ADD, vPidFd[n], &ev) == 0)
+            {
+                Result.strMessage = "timeout";
+                ++nPending;
+                continue;
+            }
+        }
+
+        Result.bOk = true;
+        Result.strMessage = Cmd == FleetCmd::Stop ? "signal sent" : (Cmd == FleetCmd::Reload ? "reload sent" : "running");
+        Result.tLatency = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - vSent[n]);
+    }
+
+    const auto tEnd = chrono::steady_clock::now() + tTimeout;
+    epoll_event aEvents[64];
+    while (nPending > 0)
+    {
+        const long long nWait = chrono::duration_cast<chrono::milliseconds>(tEnd - chrono::steady_clock::now()).count();
+        if (nWait < 0)
+            break;
+        const int iCount = epoll_wait(fdEpoll, aEvents, 64, static_cast<int>(nWait));
+        if (iCount < 0 && errno == EINTR)
+            continue;
+        if (iCount <= 0)
+            break;
+
+        const auto tNow = chrono::steady_clock::now();
+        for (int i = 0; i < iCount; ++i)
+        {
+            const size_t n = static_cast<size_t>(aEvents[i].data.u64);
+            epoll_ctl(fdEpoll, EPOLL_CTL_DEL, vPidFd[n], nullptr);
+            vResult[n].bOk = true;
+            vResult[n].strMessage = "stopped";
+            vResult[n].tLatency = chrono::duration_cast<chrono::microseconds>(tNow - vSent[n]);
+            --nPending;
+        }
+    }
+
+    for (const int fdPid : vPidFd)
+    {
+        if (fdPid >= 0)
+            close(fdPid);
+    }
+    if (fdEpoll >= 0)
+        close(fdEpoll);
+
+    return vResult;
+}
+#endif
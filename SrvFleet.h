@@ -0,0 +1,62 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVFLEET_H
+#define SRVFLEET_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+enum class FleetCmd { Stop, Reload, Status };
+
+struct FleetResult
+{
+    std::string strName;
+    pid_t       nPid;
+    bool        bOk;
+    std::string strMessage;
+    std::chrono::microseconds tLatency;
+};
+
+// Controls many services at once. The command is sent to all services before we wait,
+// the waiting is done with one epoll over the pidfds of all services.
+class CSrvFleet
+{
+public:
+    // strComm is the process name of the services, empty = the service name
+    explicit CSrvFleet(const std::string& strRunTimeDir, const std::string& strComm = std::string());
+    CSrvFleet() = delete;
+    CSrvFleet(const CSrvFleet&) = delete;
+    CSrvFleet(CSrvFleet&&) = delete;
+    CSrvFleet& operator=(const CSrvFleet&) = delete;
+    CSrvFleet& operator=(CSrvFleet&&) = delete;
+
+    // a service name (the pid is taken from the pid file or the process name) or a pid
+    void Add(const std::string& strService) { m_vServices.push_back(strService); }
+    std::vector<FleetResult> Execute(FleetCmd Cmd, std::chrono::milliseconds tTimeout);
+
+    pid_t FindPid(const std::string& strService) const;
+    static int  OpenPid(pid_t nPid) noexcept;
+    // returns 1 if the process has ended, 0 on timeout, -1 if pidfds are not supported, tTimeout < 0 waits forever
+    static int  WaitForExit(pid_t nPid, std::chrono::milliseconds tTimeout) noexcept;
+
+private:
+    std::string              m_strRunTimeDir;
+    std::string              m_strComm;
+    std::vector<std::string> m_vServices;
+};
+#endif
+
+#endif // SRVFLEET_H
@@ -0,0 +1,121 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvHeap.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    atomic<uint64_t> s_nTrims{0};
+    atomic<int64_t>  s_nReleasedKb{0};
+    uint64_t         s_nLastCpuNs{0};       // only used by the event loop thread
+    bool             s_bTrimmedIdle{false};
+
+    int64_t GetRssKb()
+    {
+        int64_t nRssKb{0};
+        FILE* fp = fopen("/proc/self/statm", "r");
+        if (fp != nullptr)
+        {
+            long long nSize{0}, nResident{0};
+            if (fscanf(fp, "%lld %lld", &nSize, &nResident) == 2)
+                nRssKb = nResident * sysconf(_SC_PAGESIZE) / 1024;
+            fclose(fp);
+        }
+        return nRssKb;
+    }
+
+    uint64_t GetCpuNs()
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+    }
+}
+
+int CSrvHeap::GetSignal() noexcept
+{
+    return SIGRTMIN + 2;
+}
+
+void CSrvHeap::Configure(uint32_t nArenaMax, const vector<pair<int, int>>& vMallopt)
+{
+#if defined(__GLIBC__)
+    if (nArenaMax > 0)
+        mallopt(M_ARENA_MAX, static_cast<int>(nArenaMax));
+    for (const auto& itOption : vMallopt)
+        mallopt(itOption.first, itOption.second);
+#else
+    static_cast<void>(nArenaMax);
+    static_cast<void>(vMallopt);
+#endif
+}
+
+int64_t CSrvHeap::Trim()
+{
+#if defined(__GLIBC__)
+    const int64_t nRssKb = GetRssKb();
+    malloc_trim(0);
+    const int64_t nReleasedKb = nRssKb - GetRssKb();
+    ++s_nTrims;
+    if (nReleasedKb > 0)
+        s_nReleasedKb += nReleasedKb;
+    return nReleasedKb;
+#else
+    return 0;
+#endif
+}
+
+void CSrvHeap::TrimIfIdle(chrono::milliseconds tInterval)
+{
+    const uint64_t nCpuNs = GetCpuNs();
+    const uint64_t nUsedNs = nCpuNs - s_nLastCpuNs;
+    s_nLastCpuNs = nCpuNs;
+
+    if (nUsedNs * 100 >= static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(tInterval).count()))
+        s_bTrimmedIdle = false;     // busy again
+    else if (s_bTrimmedIdle == false)
+    {
+        s_bTrimmedIdle = true;
+        Trim();
+    }
+}
+
+void CSrvHeap::GetStats(StatsList& lstStats)
+{
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 33)
+    const struct mallinfo2 mi = mallinfo2();
+#else
+    const struct mallinfo mi = mallinfo();   // int fields, wrong above 2 GB
+#endif
+    lstStats.emplace_back("arena_bytes", to_string(mi.arena));
+    lstStats.emplace_back("mmap_bytes", to_string(mi.hblkhd));
+    lstStats.emplace_back("in_use_bytes", to_string(mi.uordblks));
+    lstStats.emplace_back("free_bytes", to_string(mi.fordblks));
+    lstStats.emplace_back("releasable_bytes", to_string(mi.keepcost));
+#endif
+    lstStats.emplace_back("trims", to_string(s_nTrims.load()));
+    lstStats.emplace_back("trim_released_kb", to_string(s_nReleasedKb.load()));
+}
+#endif
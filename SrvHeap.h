@@ -0,0 +1,42 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVHEAP_H
+#define SRVHEAP_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvStats.h"
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// glibc malloc settings, giving free heap memory back to the system and the heap statistics.
+// Without glibc (musl) the functions do nothing.
+class CSrvHeap
+{
+public:
+    // the signal that trims the heap (SIGRTMIN + 2)
+    static int  GetSignal() noexcept;
+
+    // call before the threads are created, the arenas that exist already stay
+    static void Configure(uint32_t nArenaMax, const std::vector<std::pair<int, int>>& vMallopt);
+    // malloc_trim, returns the reduction of the RSS in KB
+    static int64_t Trim();
+    // trims once if the process used less than 1% cpu since the last call, call it periodically
+    static void TrimIfIdle(std::chrono::milliseconds tInterval);
+    static void GetStats(StatsList& lstStats);
+};
+#endif
+
+#endif // SRVHEAP_H
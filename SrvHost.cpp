@@ -0,0 +1,167 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#include "SrvHost.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <stdexcept>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvProfiler.h"
+#include "SrvHeap.h"
+#include "SrvThreadStats.h"
+#endif
+
+using namespace std;
+
+namespace
+{
+    string GetStatsName(const wchar_t* szName)
+    {
+        const wstring strName = szName != nullptr ? szName : L"";
+        string strDst(strName.size() * 4, 0);
+        const size_t nWritten = wcstombs(&strDst[0], strName.c_str(), strDst.size());
+        strDst.resize(nWritten != static_cast<size_t>(-1) ? nWritten : 0);
+        for (char& c : strDst)
+        {
+            if (c == ' ' || c == '.')
+                c = '_';
+        }
+        return strDst;
+    }
+}
+
+CSrvHost::CSrvHost(const vector<SrvParam>& vSrvPara, const SrvRuntimeHooks& Hooks) : m_bStop(false), m_bIdleStop(false)
+{
+    if (vSrvPara.empty() == true)
+        throw invalid_argument("CSrvHost needs at least one SrvParam");
+
+    for (size_t n = 0; n < vSrvPara.size(); ++n)
+    {
+        SrvRuntimeHooks RuntimeHooks = Hooks;
+        RuntimeHooks.bProcessWide = n == 0;
+        if (RuntimeHooks.fnIdle == nullptr)     // the process exits, so all services stop
+        {
+            RuntimeHooks.fnIdle = [this]()
+            {
+                {
+                    lock_guard<mutex> lock(m_mxStop);
+                    m_bIdleStop = true;
+                }
+                Stop();
+            };
+        }
+        if (vSrvPara.size() > 1)
+            RuntimeHooks.strStatsPrefix = Hooks.strStatsPrefix + GetStatsName(vSrvPara[n].szSrvName) + ".";
+#if !defined(_WIN32) && !defined(_WIN64)
+        RuntimeHooks.pEventLoop = &m_EventLoop;
+#endif
+        m_vRuntimes.emplace_back(new CSrvRuntime(vSrvPara[n], RuntimeHooks));
+    }
+}
+
+CSrvHost::~CSrvHost()
+{
+    Stop();
+#if !defined(_WIN32) && !defined(_WIN64)
+    m_EventLoop.Stop();
+#endif
+}
+
+bool CSrvHost::Run()
+{
+    {
+        lock_guard<mutex> lock(m_mxStop);
+        m_bStop = false;
+        m_bIdleStop = false;
+    }
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    for (const int iSignal : { SIGHUP, SIGQUIT, SIGTERM, SIGINT, SIGUSR1, SIGUSR2, CSrvProfiler::GetSignal(), CSrvHeap::GetSignal() })
+    {
+        m_EventLoop.OnSignal(iSignal, [this, iSignal]()
+        {
+            if (iSignal == SIGHUP)
+            {
+                for (auto& pRuntime : m_vRuntimes)
+                    pRuntime->HandleSignal(iSignal);
+            }
+            else if (iSignal == SIGQUIT || iSignal == SIGTERM || iSignal == SIGINT)
+                Stop();
+            else    // the process wide signals are handled by the first service
+                m_vRuntimes.front()->HandleSignal(iSignal);
+        });
+    }
+    m_EventLoop.Post([]() { CSrvThreadStats::RegisterThread("EventLoop"); });
+    m_EventLoop.Start();
+#endif
+
+    for (auto& pRuntime : m_vRuntimes)
+        pRuntime->Start();
+
+    bool bReady = true;
+    for (auto& pRuntime : m_vRuntimes)
+    {
+        while (bReady == true && pRuntime->WaitReady(chrono::milliseconds(100)) == false)
+        {
+            lock_guard<mutex> lock(m_mxStop);
+            if (pRuntime->IsStopped() == true || m_bStop == true)
+                bReady = false;
+        }
+    }
+    if (m_fnReady != nullptr)
+        m_fnReady(bReady);
+
+    if (bReady == true)
+    {
+        unique_lock<mutex> lock(m_mxStop);
+        m_cvStop.wait(lock, [&]() { return m_bStop; });
+    }
+
+    for (auto itRuntime = m_vRuntimes.rbegin(); itRuntime != m_vRuntimes.rend(); ++itRuntime)
+        (*itRuntime)->Stop();
+    for (auto itRuntime = m_vRuntimes.rbegin(); itRuntime != m_vRuntimes.rend(); ++itRuntime)
+        (*itRuntime)->Wait();
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    m_EventLoop.Stop();
+    if (CSrvProfiler::IsActive() == true)
+        m_vRuntimes.front()->HandleSignal(CSrvProfiler::GetSignal());
+#endif
+    return bReady;
+}
+
+void CSrvHost::Stop()
+{
+    {
+        lock_guard<mutex> lock(m_mxStop);
+        m_bStop = true;
+    }
+    m_cvStop.notify_all();
+}
+
+bool CSrvHost::IsIdleStop()
+{
+    lock_guard<mutex> lock(m_mxStop);
+    return m_bIdleStop;
+}
+
+void CSrvHost::Signal(int iSignal)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    for (auto& pRuntime : m_vRuntimes)
+        pRuntime->Signal(iSignal);
+#else
+    m_EventLoop.PostSignal(iSignal);
+#endif
+}
@@ -0,0 +1,68 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVHOST_H
+#define SRVHOST_H
+
+#include "Service.h"
+#include "SrvRuntime.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Several services in one process. Every service has its own CSrvRuntime and can be started, stopped and reloaded
+// on its own. The event loop, the logger and the process wide settings (from the first SrvParam) are shared.
+class CSrvHost
+{
+public:
+    explicit CSrvHost(const std::vector<SrvParam>& vSrvPara, const SrvRuntimeHooks& Hooks = SrvRuntimeHooks());
+    ~CSrvHost();
+    CSrvHost() = delete;
+    CSrvHost(const CSrvHost&) = delete;
+    CSrvHost(CSrvHost&&) = delete;
+    CSrvHost& operator=(const CSrvHost&) = delete;
+    CSrvHost& operator=(CSrvHost&&) = delete;
+
+    // starts all services and waits until Stop is called, false if a service could not be started
+    bool Run();
+    void Stop();
+    // same signals as CSrvRuntime::Signal, SIGHUP reloads all services, the stop signals stop the host
+    void Signal(int iSignal);
+    // true if the last Run ended because a service was idle (nIdleTimeoutMs)
+    bool IsIdleStop();
+
+    size_t GetCount() const noexcept { return m_vRuntimes.size(); }
+    CSrvRuntime& GetRuntime(size_t nIndex) { return *m_vRuntimes[nIndex]; }
+
+    // called when all services are ready, or one failed
+    void SetReadyCallBack(std::function<void(bool)> fnReady) { m_fnReady = fnReady; }
+    void SetTraceFile(const std::string& strTraceFile) { m_vRuntimes.front()->SetTraceFile(strTraceFile); }
+    void SetStatsFile(const std::string& strStatsFile) { m_vRuntimes.front()->SetStatsFile(strStatsFile); }
+    void SetProfileFile(const std::string& strProfileFile) { m_vRuntimes.front()->SetProfileFile(strProfileFile); }
+
+private:
+#if !defined(_WIN32) && !defined(_WIN64)
+    CSrvEventLoop m_EventLoop;
+#endif
+    std::vector<std::unique_ptr<CSrvRuntime>> m_vRuntimes;
+    std::function<void(bool)> m_fnReady;
+    std::mutex              m_mxStop;
+    std::condition_variable m_cvStop;
+    bool                    m_bStop;
+    bool                    m_bIdleStop;
+};
+
+#endif // SRVHOST_H
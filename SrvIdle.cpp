@@ -0,0 +1,58 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#include "SrvIdle.h"
+
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+namespace
+{
+    atomic<int64_t>  s_nLastActivity{chrono::steady_clock::now().time_since_epoch().count()};
+    atomic<uint32_t> s_nActive{0};
+    atomic<uint64_t> s_nRequests{0};
+}
+
+void CSrvIdle::Touch() noexcept
+{
+    s_nLastActivity.store(chrono::steady_clock::now().time_since_epoch().count(), memory_order_relaxed);
+}
+
+void CSrvIdle::BeginWork() noexcept
+{
+    s_nActive.fetch_add(1, memory_order_relaxed);
+    s_nRequests.fetch_add(1, memory_order_relaxed);
+    Touch();
+}
+
+void CSrvIdle::EndWork() noexcept
+{
+    Touch();
+    s_nActive.fetch_sub(1, memory_order_relaxed);
+}
+
+chrono::milliseconds CSrvIdle::GetIdleTime() noexcept
+{
+    if (s_nActive.load(memory_order_relaxed) > 0)
+        return chrono::milliseconds(0);
+    const chrono::steady_clock::time_point tLast(chrono::steady_clock::duration(s_nLastActivity.load(memory_order_relaxed)));
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - tLast);
+}
+
+void CSrvIdle::GetStats(StatsList& lstStats)
+{
+    lstStats.emplace_back("idle_ms", to_string(GetIdleTime().count()));
+    lstStats.emplace_back("active", to_string(s_nActive.load(memory_order_relaxed)));
+    lstStats.emplace_back("requests", to_string(s_nRequests.load(memory_order_relaxed)));
+}
@@ -0,0 +1,46 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVIDLE_H
+#define SRVIDLE_H
+
+#include "SrvStats.h"
+
+#include <chrono>
+
+// Activity of the process, the service calls Touch for every request (or wraps it in a CSrvIdleWork).
+// With nIdleTimeoutMs in the SrvParam struct the runtime stops the service if nothing happened for that time.
+class CSrvIdle
+{
+public:
+    static void Touch() noexcept;
+    // requests in flight, the process is not idle until all of them ended
+    static void BeginWork() noexcept;
+    static void EndWork() noexcept;
+
+    // 0 while a request is in flight
+    static std::chrono::milliseconds GetIdleTime() noexcept;
+    static void GetStats(StatsList& lstStats);
+};
+
+class CSrvIdleWork
+{
+public:
+    CSrvIdleWork() noexcept { CSrvIdle::BeginWork(); }
+    ~CSrvIdleWork() { CSrvIdle::EndWork(); }
+    CSrvIdleWork(const CSrvIdleWork&) = delete;
+    CSrvIdleWork(CSrvIdleWork&&) = delete;
+    CSrvIdleWork& operator=(const CSrvIdleWork&) = delete;
+    CSrvIdleWork& operator=(CSrvIdleWork&&) = delete;
+};
+
+#endif // SRVIDLE_H
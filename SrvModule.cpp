@@ -0,0 +1,199 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvModule.h"
+
+#include <cerrno>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+
+using namespace std;
+
+namespace
+{
+    bool SameFile(const struct stat& st1, const struct stat& st2)
+    {
+        return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino && st1.st_size == st2.st_size
+            && st1.st_mtim.tv_sec == st2.st_mtim.tv_sec && st1.st_mtim.tv_nsec == st2.st_mtim.tv_nsec;
+    }
+}
+
+shared_ptr<SrvModuleInstance> CSrvModule::Open(string& strError)
+{
+    // dlopen returns the loaded library for a known path, a copy in a memfd has a new one as long as the memfd
+    // is open. The deployment may replace the file while we read, the copy is what we load.
+    const int fdFile = open(m_strPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fdFile < 0)
+    {
+        strError = m_strPath + ": " + strerror(errno);
+        return nullptr;
+    }
+    struct stat st;
+    const int fdCopy = fstat(fdFile, &st) == 0 ? memfd_create("SrvModule", MFD_CLOEXEC) : -1;
+    off_t nOffset = 0;
+    while (fdCopy >= 0 && nOffset < st.st_size && sendfile(fdCopy, fdFile, &nOffset, static_cast<size_t>(st.st_size - nOffset)) > 0);
+    close(fdFile);
+    if (fdCopy < 0 || nOffset != st.st_size)
+    {
+        strError = m_strPath + ": cannot copy: " + strerror(errno);
+        if (fdCopy >= 0)
+            close(fdCopy);
+        return nullptr;
+    }
+
+    void* hLib = dlopen(("/proc/self/fd/" + to_string(fdCopy)).c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (hLib == nullptr)
+    {
+        strError = dlerror();
+        close(fdCopy);
+        return nullptr;
+    }
+
+    typedef const SrvModuleApi* (*EntryFn)(void);
+    const EntryFn fnEntry = reinterpret_cast<EntryFn>(dlsym(hLib, "SrvModuleEntry"));
+    const SrvModuleApi* pApi = fnEntry != nullptr ? fnEntry() : nullptr;
+    if (pApi == nullptr || pApi->nAbiVersion != SRVMODULE_ABI_VERSION)
+    {
+        strError = m_strPath + (pApi == nullptr ? ": no SrvModuleEntry" : ": ABI version " + to_string(pApi->nAbiVersion) + " instead of " + to_string(SRVMODULE_ABI_VERSION));
+        dlclose(hLib);
+        close(fdCopy);
+        return nullptr;
+    }
+
+    m_stFile = st;
+    // the state is freed and the library closed with the last reference, after the last call into it
+    return shared_ptr<SrvModuleInstance>(new SrvModuleInstance{ pApi, nullptr, ++m_nGenerations, false, nullptr }, [hLib, fdCopy, pApi](SrvModuleInstance* pInstance)
+    {
+        if (pInstance->pState != nullptr && pInstance->bRetired == false && pApi->pfnStop != nullptr)
+            pApi->pfnStop(pInstance->pState);
+        else if (pInstance->pState != nullptr && pInstance->bRetired == true && pInstance->pTakenOverBy == nullptr && pApi->pfnFree != nullptr)
+            pApi->pfnFree(pInstance->pState);
+        delete pInstance;
+        dlclose(hLib);
+        close(fdCopy);
+    });
+}
+
+bool CSrvModule::Load(const string& strPath)
+{
+    lock_guard<mutex> lock(m_mxModule);
+    if (m_pCurrent != nullptr)
+        return false;
+
+    m_strPath = strPath;
+    string strError;
+    shared_ptr<SrvModuleInstance> pInstance = Open(strError);
+    if (pInstance == nullptr)
+    {
+        syslog(LOG_ERR, "module %s", strError.c_str());
+        return false;
+    }
+    pInstance->pState = pInstance->pApi->pfnStart != nullptr ? pInstance->pApi->pfnStart() : nullptr;
+    if (pInstance->pState == nullptr)
+    {
+        syslog(LOG_ERR, "module %s: the start failed", m_strPath.c_str());
+        return false;
+    }
+    m_pCurrent = pInstance;
+    syslog(LOG_NOTICE, "module %s version %u loaded", m_strPath.c_str(), pInstance->pApi->nModuleVersion);
+    return true;
+}
+
+bool CSrvModule::Reload()
+{
+    lock_guard<mutex> lock(m_mxModule);
+    if (m_pCurrent == nullptr)
+        return false;
+
+    struct stat st;
+    if (stat(m_strPath.c_str(), &st) != 0 || SameFile(st, m_stFile) == true)
+    {
+        if (m_pCurrent->pApi->pfnReload != nullptr)
+            m_pCurrent->pApi->pfnReload(m_pCurrent->pState);
+        return true;
+    }
+
+    string strError;
+    shared_ptr<SrvModuleInstance> pInstance = Open(strError);
+    if (pInstance != nullptr && pInstance->pApi->pfnMigrate == nullptr)
+        strError = m_strPath + ": no pfnMigrate";
+    else if (pInstance != nullptr)
+    {
+        pInstance->pState = pInstance->pApi->pfnMigrate(m_pCurrent->pState, m_pCurrent->pApi->nModuleVersion);
+        if (pInstance->pState == nullptr)
+            strError = m_strPath + ": version " + to_string(pInstance->pApi->nModuleVersion) + " refused the state of version " + to_string(m_pCurrent->pApi->nModuleVersion);
+    }
+    if (strError.empty() == false)
+    {
+        // the file is not tried again until it changes
+        ++m_nFailedSwaps;
+        syslog(LOG_ERR, "module %s", strError.c_str());
+        if (pInstance == nullptr)
+            m_stFile = st;
+        return false;
+    }
+
+    syslog(LOG_NOTICE, "module %s version %u replaced version %u", m_strPath.c_str(), pInstance->pApi->nModuleVersion, m_pCurrent->pApi->nModuleVersion);
+    // the old version frees its state when its last call has returned. A state taken over unchanged is still used by
+    // these calls, the new version must not stop it before, so the old one holds it.
+    m_pCurrent->bRetired = true;
+    if (pInstance->pState == m_pCurrent->pState)
+        m_pCurrent->pTakenOverBy = pInstance;
+    m_vRetired.push_back(m_pCurrent);
+    m_pCurrent = pInstance;
+    ++m_nSwaps;
+    return true;
+}
+
+void CSrvModule::Unload()
+{
+    // pfnStop is called by the last reference outside the lock, that may be a call still running in another thread
+    shared_ptr<SrvModuleInstance> pInstance;
+    {
+        lock_guard<mutex> lock(m_mxModule);
+        pInstance.swap(m_pCurrent);
+    }
+}
+
+shared_ptr<const SrvModuleInstance> CSrvModule::Get() const
+{
+    lock_guard<mutex> lock(m_mxModule);
+    return m_pCurrent;
+}
+
+void CSrvModule::GetStats(StatsList& lstStats)
+{
+    lock_guard<mutex> lock(m_mxModule);
+    size_t nRetired = 0;
+    for (auto itRetired = m_vRetired.begin(); itRetired != m_vRetired.end();)
+    {
+        if (itRetired->expired() == true)
+            itRetired = m_vRetired.erase(itRetired);
+        else
+        {
+            ++nRetired;
+            ++itRetired;
+        }
+    }
+    lstStats.emplace_back("version", m_pCurrent != nullptr ? to_string(m_pCurrent->pApi->nModuleVersion) : string("-"));
+    lstStats.emplace_back("generation", m_pCurrent != nullptr ? to_string(m_pCurrent->nGeneration) : string("0"));
+    lstStats.emplace_back("swaps", to_string(m_nSwaps));
+    lstStats.emplace_back("failed_swaps", to_string(m_nFailedSwaps));
+    lstStats.emplace_back("retired_open", to_string(nRetired));
+}
+#endif
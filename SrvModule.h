@@ -0,0 +1,103 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVMODULE_H
+#define SRVMODULE_H
+
+#include <stdint.h>
+
+// The C ABI between the service and its logic in a shared object. The module exports
+//     extern "C" const SrvModuleApi* SrvModuleEntry(void);
+// and is built against the same SRVMODULE_ABI_VERSION. The state is owned by the module, the service only passes it on.
+// pfnStop and pfnFree are called after the last call into that version returned, just before it is closed.
+#define SRVMODULE_ABI_VERSION 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+typedef struct
+{
+    uint32_t nAbiVersion;                   // SRVMODULE_ABI_VERSION
+    uint32_t nModuleVersion;                // version of the module logic, logged and passed to pfnMigrate
+    void* (*pfnStart)(void);                // first load, returns the state, NULL if the start failed
+    void  (*pfnStop)(void* pState);         // service stop, frees the state
+    void  (*pfnReload)(void* pState);       // reload with the same module, e.g. the configuration
+    // called in the new module, takes over the state of the old one (converts it or returns it unchanged),
+    // NULL keeps the old module running. The old module may still run calls which started before.
+    void* (*pfnMigrate)(void* pOldState, uint32_t nOldVersion);
+    // called in the old module after a migration, frees what the new one did not take over. Not called if
+    // pfnMigrate returned the old state unchanged.
+    void  (*pfnFree)(void* pState);
+    const void* pInterface;                 // the functions of the service logic, the service knows the type
+}SrvModuleApi;
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(__cplusplus) && !defined(_WIN32) && !defined(_WIN64)
+#include "SrvStats.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+typedef struct
+{
+    const SrvModuleApi* pApi;
+    void* pState;
+    uint32_t nGeneration;                   // counts the loaded versions
+    bool bRetired;                          // replaced by a newer version, only read when it is closed
+    // the newer version using pState unchanged, it is kept until our last call returned and then stops the state
+    std::shared_ptr<const void> pTakenOverBy;
+}SrvModuleInstance;
+
+// Loads the module, and on Reload a new version of the file: the new one migrates the state, the old one is closed
+// when the last call into it has returned. A caller holds the result of Get() while it calls into the module.
+class CSrvModule
+{
+public:
+    CSrvModule() = default;
+    ~CSrvModule() { Unload(); }
+    CSrvModule(const CSrvModule&) = delete;
+    CSrvModule(CSrvModule&&) = delete;
+    CSrvModule& operator=(const CSrvModule&) = delete;
+    CSrvModule& operator=(CSrvModule&&) = delete;
+
+    // loads and starts the module, false if it is not loadable, has another ABI version or pfnStart returned NULL
+    bool Load(const std::string& strPath);
+    // a changed file is loaded and takes over the state, otherwise pfnReload is called. false if the new
+    // version was refused, the old one is still running then.
+    bool Reload();
+    // releases the module, pfnStop runs and the module is closed when the last call into it has returned
+    void Unload();
+
+    std::shared_ptr<const SrvModuleInstance> Get() const;
+    void GetStats(StatsList& lstStats);
+
+private:
+    std::shared_ptr<SrvModuleInstance> Open(std::string& strError);
+
+private:
+    mutable std::mutex       m_mxModule;
+    std::string              m_strPath;
+    struct stat              m_stFile{};
+    std::shared_ptr<SrvModuleInstance> m_pCurrent;
+    std::vector<std::weak_ptr<SrvModuleInstance>> m_vRetired;
+    uint32_t                 m_nGenerations{0};
+    uint64_t                 m_nSwaps{0};
+    uint64_t                 m_nFailedSwaps{0};
+};
+#endif
+
+#endif // SRVMODULE_H
@@ -0,0 +1,78 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvNotify.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+bool CSrvNotify::IsAvailable()
+{
+    const char* szSocket = getenv("NOTIFY_SOCKET");
+    return szSocket != nullptr && (szSocket[0] == '/' || szSocket[0] == '@');
+}
+
+bool CSrvNotify::Notify(const string& strState)
+{
+    return Notify(strState, vector<int>());
+}
+
+bool CSrvNotify::Notify(const string& strState, const vector<int>& vFds)
+{
+    const char* szSocket = getenv("NOTIFY_SOCKET");
+    if (szSocket == nullptr || (szSocket[0] != '/' && szSocket[0] != '@'))
+        return false;
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    const size_t nLen = strlen(szSocket);
+    if (nLen >= sizeof(addr.sun_path))
+        return false;
+    memcpy(addr.sun_path, szSocket, nLen);
+    if (addr.sun_path[0] == '@')    // abstract namespace
+        addr.sun_path[0] = '\0';
+
+    iovec iov{ const_cast<char*>(strState.c_str()), strState.size() };
+    msghdr msg{};
+    msg.msg_name = &addr;
+    msg.msg_namelen = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + nLen);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    vector<char> vControl;
+    if (vFds.empty() == false)
+    {
+        vControl.resize(CMSG_SPACE(sizeof(int) * vFds.size()));
+        msg.msg_control = vControl.data();
+        msg.msg_controllen = vControl.size();
+        cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg);
+        pCmsg->cmsg_level = SOL_SOCKET;
+        pCmsg->cmsg_type = SCM_RIGHTS;
+        pCmsg->cmsg_len = CMSG_LEN(sizeof(int) * vFds.size());
+        memcpy(CMSG_DATA(pCmsg), vFds.data(), sizeof(int) * vFds.size());
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    const ssize_t nSent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    close(fd);
+    return nSent == static_cast<ssize_t>(strState.size());
+}
+#endif
@@ -0,0 +1,32 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVNOTIFY_H
+#define SRVNOTIFY_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <string>
+#include <vector>
+
+// sd_notify without libsystemd, the state is sent as datagram to the socket in $NOTIFY_SOCKET
+class CSrvNotify
+{
+public:
+    static bool IsAvailable();
+    // e.g. "READY=1", "RELOADING=1", "STOPPING=1" or "STATUS=...", several lines separated by '\n'
+    static bool Notify(const std::string& strState);
+    // the fds are sent with SCM_RIGHTS, e.g. "FDSTORE=1\nFDNAME=name"
+    static bool Notify(const std::string& strState, const std::vector<int>& vFds);
+};
+#endif
+
+#endif // SRVNOTIFY_H
@@ -0,0 +1,104 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvPressure.h"
+#include "SrvCgroup.h"
+#include "SrvTrace.h"
+
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+using namespace std;
+
+string CSrvPressure::GetFile(const SrvPressureTrigger& Trigger)
+{
+    if (Trigger.strResource.empty() == false && Trigger.strResource[0] == '/')
+        return Trigger.strResource;
+    if (Trigger.bCgroup == true)
+        return CSrvCgroup::GetServicePath() + "/" + Trigger.strResource + ".pressure";
+    return "/proc/pressure/" + Trigger.strResource;
+}
+
+bool CSrvPressure::AddTrigger(const SrvPressureTrigger& Trigger, function<void(const SrvPressureTrigger&)> fnCallBack)
+{
+    const string strFile = GetFile(Trigger);
+    const int fd = open(strFile.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        syslog(LOG_WARNING, "%s", string("PSI: cannot open " + strFile + ": " + strerror(errno)).c_str());
+        return false;
+    }
+
+    // the trigger is "<some|full> <stall us> <window us>", the kernel wants the terminating 0
+    const string strTrigger = string(Trigger.bFull == true ? "full " : "some ") + to_string(Trigger.nStallUs) + " " + to_string(Trigger.nWindowUs);
+    if (write(fd, strTrigger.c_str(), strTrigger.size() + 1) < 0)
+    {
+        syslog(LOG_WARNING, "%s", string("PSI: trigger \"" + strTrigger + "\" rejected by " + strFile + ": " + strerror(errno)).c_str());
+        close(fd);
+        return false;
+    }
+
+    const bool bAdded = m_EventLoop.AddFd(fd, EPOLLPRI, [this, fd, Trigger, fnCallBack](uint32_t nEvents)
+    {
+        if ((nEvents & EPOLLERR) != 0)
+        {   // the monitored cgroup is gone
+            m_EventLoop.RemoveFd(fd);
+            return;
+        }
+        SRVTRACE_SCOPE("PressureCallBack");
+        if (fnCallBack != nullptr)
+            fnCallBack(Trigger);
+    });
+    if (bAdded == false)
+    {
+        syslog(LOG_WARNING, "%s", string("PSI: cannot watch " + strFile + ": " + strerror(errno)).c_str());
+        close(fd);
+        return false;
+    }
+    m_vFds.push_back(fd);
+    return true;
+}
+
+void CSrvPressure::RemoveAll()
+{
+    for (const int fd : m_vFds)
+    {
+        m_EventLoop.RemoveFd(fd);
+        close(fd);
+    }
+    m_vFds.clear();
+}
+
+void CSrvPressure::GetStats(StatsList& lstStats)
+{
+    // "some avg10=0.00 avg60=0.00 avg300=0.00 total=0"
+    for (const char* szResource : { "cpu", "memory", "io" })
+    {
+        ifstream fin(string("/proc/pressure/") + szResource);
+        string strKind, strValue;
+        while (fin >> strKind)
+        {
+            for (int n = 0; n < 4 && fin >> strValue; ++n)
+            {
+                const size_t nPos = strValue.find('=');
+                if (nPos != string::npos)
+                    lstStats.emplace_back(string(szResource) + "." + strKind + "." + strValue.substr(0, nPos), strValue.substr(nPos + 1));
+            }
+        }
+    }
+}
+#endif
@@ -0,0 +1,49 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVPRESSURE_H
+#define SRVPRESSURE_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "Service.h"
+#include "SrvEventLoop.h"
+#include "SrvStats.h"
+
+#include <functional>
+#include <vector>
+
+// PSI (pressure stall information) triggers, the kernel wakes up the event loop with POLLPRI
+// at most once per window if the stall time is exceeded
+class CSrvPressure
+{
+public:
+    explicit CSrvPressure(CSrvEventLoop& EventLoop) : m_EventLoop(EventLoop) {}
+    ~CSrvPressure() { RemoveAll(); }
+    CSrvPressure() = delete;
+    CSrvPressure(const CSrvPressure&) = delete;
+    CSrvPressure(CSrvPressure&&) = delete;
+    CSrvPressure& operator=(const CSrvPressure&) = delete;
+    CSrvPressure& operator=(CSrvPressure&&) = delete;
+
+    bool AddTrigger(const SrvPressureTrigger& Trigger, std::function<void(const SrvPressureTrigger&)> fnCallBack);
+    void RemoveAll();
+
+    static std::string GetFile(const SrvPressureTrigger& Trigger);
+    static void GetStats(StatsList& lstStats);
+
+private:
+    CSrvEventLoop&   m_EventLoop;
+    std::vector<int> m_vFds;
+};
+#endif
+
+#endif // SRVPRESSURE_H
@@ -0,0 +1,309 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvProfiler.h"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cxxabi.h>
+#include <dirent.h>
+#include <execinfo.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+using namespace std;
+
+namespace
+{
+    constexpr int MAX_DEPTH = 48;
+    constexpr int SKIP_FRAMES = 2;      // the signal handler and the signal trampoline
+
+    struct ProfSample
+    {
+        pid_t    nTid;
+        int      nDepth;
+        void*    aFrames[MAX_DEPTH];
+    };
+
+    struct ProfState
+    {
+        mutex                   mxControl;
+        atomic<bool>            bActive{false};
+        atomic<uint32_t>        nInHandler{0};
+        atomic<uint64_t>        nNext{0};
+        unique_ptr<ProfSample[]> pSamples;
+        size_t                  nCapacity{0};
+        uint32_t                nHz{0};
+        map<pid_t, timer_t>     mapTimers;
+    };
+    ProfState s_State;
+
+    void ProfHandler(int, siginfo_t*, void*)
+    {
+        const int iErrno = errno;
+        s_State.nInHandler.fetch_add(1);
+        if (s_State.bActive.load() == true)
+        {
+            const uint64_t nIndex = s_State.nNext.fetch_add(1);
+            if (nIndex < s_State.nCapacity)
+            {
+                ProfSample& Sample = s_State.pSamples[nIndex];
+                Sample.nTid = static_cast<pid_t>(syscall(SYS_gettid));
+                Sample.nDepth = backtrace(Sample.aFrames, MAX_DEPTH);
+            }
+        }
+        s_State.nInHandler.fetch_sub(1);
+        errno = iErrno;
+    }
+
+    // the cpu time clock of a thread of our process, MAKE_THREAD_CPUCLOCK(tid, CPUCLOCK_SCHED) of the kernel
+    clockid_t GetThreadClock(pid_t nTid) noexcept
+    {
+        return static_cast<clockid_t>((~static_cast<uint32_t>(nTid) << 3) | 6u);
+    }
+
+    // call with mxControl locked, false if no thread has a timer
+    bool AddThreadTimers()
+    {
+        DIR* dir = opendir("/proc/self/task");
+        if (dir == nullptr)
+            return false;
+
+        map<pid_t, timer_t> mapTimers;
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != nullptr)
+        {
+            char* endptr;
+            const pid_t nTid = static_cast<pid_t>(strtol(ent->d_name, &endptr, 10));
+            if (*endptr != '\0' || nTid <= 0)
+                continue;
+
+            auto itTimer = s_State.mapTimers.find(nTid);
+            if (itTimer != s_State.mapTimers.end())
+            {
+                mapTimers.emplace(*itTimer);
+                s_State.mapTimers.erase(itTimer);
+                continue;
+            }
+
+            sigevent sev{};
+            sev.sigev_notify = SIGEV_THREAD_ID;
+            sev.sigev_signo = SIGPROF;
+            sev.sigev_notify_thread_id = nTid;
+            timer_t Timer;
+            if (timer_create(GetThreadClock(nTid), &sev, &Timer) != 0)
+                continue;
+            // tv_nsec must be below one second, 1 Hz is tv_sec = 1
+            const uint64_t nIntervalNs = 1000000000u / s_State.nHz;
+            itimerspec its{};
+            its.it_interval.tv_sec = static_cast<time_t>(nIntervalNs / 1000000000u);
+            its.it_interval.tv_nsec = static_cast<long>(nIntervalNs % 1000000000u);
+            its.it_value = its.it_interval;
+            if (timer_settime(Timer, 0, &its, nullptr) != 0)
+            {
+                timer_delete(Timer);
+                continue;
+            }
+            mapTimers.emplace(nTid, Timer);
+        }
+        closedir(dir);
+
+        // the timers of the ended threads
+        for (auto& itTimer : s_State.mapTimers)
+            timer_delete(itTimer.second);
+        s_State.mapTimers = move(mapTimers);
+        return s_State.mapTimers.empty() == false;
+    }
+
+    string GetFrameName(const char* szSymbol)
+    {
+        // "module(symbol+0x1a) [0x...]" or "module(+0x1234) [0x...]"
+        string strSymbol(szSymbol);
+        const size_t nOpen = strSymbol.find('(');
+        const size_t nPlus = strSymbol.find('+', nOpen);
+        const size_t nClose = strSymbol.find(')', nOpen);
+        if (nOpen == string::npos || nClose == string::npos)
+            return strSymbol;
+
+        string strModule = strSymbol.substr(0, nOpen);
+        strModule.erase(0, strModule.find_last_of('/') + 1);
+        if (nPlus == string::npos || nPlus > nClose)
+            return strModule;
+        if (nPlus == nOpen + 1)
+            return strModule + "+" + strSymbol.substr(nPlus + 1, nClose - nPlus - 1);
+
+        const string strMangled = strSymbol.substr(nOpen + 1, nPlus - nOpen - 1);
+        int iStatus{0};
+        char* szDemangled = abi::__cxa_demangle(strMangled.c_str(), nullptr, nullptr, &iStatus);
+        string strName = iStatus == 0 && szDemangled != nullptr ? szDemangled : strMangled;
+        free(szDemangled);
+        for (char& c : strName)    // ';' separates the frames, ' ' the count
+        {
+            if (c == ';' || c == ' ')
+                c = '_';
+        }
+        return strName;
+    }
+
+    string GetThreadName(pid_t nTid)
+    {
+        string strName;
+        FILE* fp = fopen(string("/proc/self/task/" + to_string(nTid) + "/comm").c_str(), "r");
+        if (fp != nullptr)
+        {
+            char szName[64] = { 0 };
+            if (fgets(szName, sizeof(szName), fp) != nullptr)
+                strName = szName;
+            fclose(fp);
+        }
+        strName.erase(strName.find_last_not_of('\n') + 1);
+        for (char& c : strName)
+        {
+            if (c == ';' || c == ' ')
+                c = '_';
+        }
+        return strName.empty() == true ? to_string(nTid) : strName;
+    }
+}
+
+int CSrvProfiler::GetSignal() noexcept
+{
+    return SIGRTMIN + 1;
+}
+
+bool CSrvProfiler::Start(uint32_t nHz, size_t nMaxSamples)
+{
+    lock_guard<mutex> lock(s_State.mxControl);
+    if (s_State.bActive == true || nHz == 0 || nHz > 1000 || nMaxSamples == 0)
+        return false;
+
+    // the first backtrace loads the unwinder, that must not happen in the signal handler
+    void* aPrime[4];
+    backtrace(aPrime, 4);
+
+    if (s_State.nCapacity != nMaxSamples)
+    {
+        s_State.pSamples.reset(new ProfSample[nMaxSamples]);
+        s_State.nCapacity = nMaxSamples;
+    }
+    s_State.nNext = 0;
+    s_State.nHz = nHz;
+
+    struct sigaction sa{};
+    sa.sa_sigaction = ProfHandler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, nullptr) != 0)
+        return false;
+
+    s_State.bActive = true;
+    if (AddThreadTimers() == false)
+    {
+        s_State.bActive = false;
+        return false;
+    }
+    return true;
+}
+
+void CSrvProfiler::Refresh()
+{
+    lock_guard<mutex> lock(s_State.mxControl);
+    if (s_State.bActive == true)
+        AddThreadTimers();
+}
+
+bool CSrvProfiler::IsActive() noexcept
+{
+    return s_State.bActive.load();
+}
+
+bool CSrvProfiler::Stop(const string& strFileName)
+{
+    lock_guard<mutex> lock(s_State.mxControl);
+    if (s_State.bActive == false)
+        return false;
+
+    for (auto& itTimer : s_State.mapTimers)
+        timer_delete(itTimer.second);
+    s_State.mapTimers.clear();
+    s_State.bActive = false;
+    while (s_State.nInHandler.load() > 0)
+        this_thread::yield();
+
+    if (strFileName.empty() == true)
+        return true;
+
+    const size_t nSamples = static_cast<size_t>(min<uint64_t>(s_State.nNext.load(), s_State.nCapacity));
+    const uint64_t nDropped = s_State.nNext.load() - nSamples;
+
+    // symbols of all different addresses with one call
+    map<void*, string> mapNames;
+    for (size_t n = 0; n < nSamples; ++n)
+    {
+        for (int i = SKIP_FRAMES; i < s_State.pSamples[n].nDepth; ++i)
+            mapNames.emplace(s_State.pSamples[n].aFrames[i], string());
+    }
+    vector<void*> vAddresses;
+    for (auto& itName : mapNames)
+        vAddresses.push_back(itName.first);
+    if (vAddresses.empty() == false)
+    {
+        char** pSymbols = backtrace_symbols(vAddresses.data(), static_cast<int>(vAddresses.size()));
+        if (pSymbols != nullptr)
+        {
+            for (size_t n = 0; n < vAddresses.size(); ++n)
+                mapNames[vAddresses[n]] = GetFrameName(pSymbols[n]);
+            free(pSymbols);
+        }
+    }
+
+    map<pid_t, string> mapThreads;
+    map<string, uint64_t> mapStacks;
+    for (size_t n = 0; n < nSamples; ++n)
+    {
+        const ProfSample& Sample = s_State.pSamples[n];
+        auto itThread = mapThreads.find(Sample.nTid);
+        if (itThread == mapThreads.end())
+            itThread = mapThreads.emplace(Sample.nTid, GetThreadName(Sample.nTid)).first;
+
+        string strStack = itThread->second;
+        for (int i = Sample.nDepth - 1; i >= SKIP_FRAMES; --i)  // root first
+            strStack += ";" + mapNames[Sample.aFrames[i]];
+        ++mapStacks[strStack];
+    }
+    if (nDropped > 0)
+        mapStacks["[dropped]"] += nDropped;
+
+    const string strTmpFile = strFileName + ".tmp";
+    FILE* fp = fopen(strTmpFile.c_str(), "w");
+    if (fp == nullptr)
+        return false;
+    for (auto& itStack : mapStacks)
+        fprintf(fp, "%s %llu\n", itStack.first.c_str(), static_cast<unsigned long long>(itStack.second));
+    const bool bOk = fclose(fp) == 0;
+    return bOk == true && rename(strTmpFile.c_str(), strFileName.c_str()) == 0;
+}
+#endif
@@ -0,0 +1,40 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVPROFILER_H
+#define SRVPROFILER_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Sampling profiler without perf and privileges. Every thread gets a timer on its own cpu time clock that sends
+// SIGPROF, the handler writes the backtrace into a preallocated buffer. Stop writes the folded stacks
+// ("thread;main;foo;bar 42"), input for flamegraph.pl or speedscope. Link with -rdynamic to see the function names
+// of the executable.
+class CSrvProfiler
+{
+public:
+    // the signal that switches the profiler on and off (SIGRTMIN + 1)
+    static int  GetSignal() noexcept;
+
+    static bool Start(uint32_t nHz = 99, size_t nMaxSamples = 16384);
+    // timers for the threads started after Start
+    static void Refresh();
+    static bool IsActive() noexcept;
+    // without a file name the samples are discarded
+    static bool Stop(const std::string& strFileName);
+};
+#endif
+
+#endif // SRVPROFILER_H
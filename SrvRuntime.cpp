@@ -0,0 +1,512 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#include "SrvRuntime.h"
+#include "SrvStats.h"
+#include "SrvTrace.h"
+#include "SrvIdle.h"
+#include "SrvArena.h"
+
+#include <algorithm>
+#include <csignal>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <Windows.h>
+#else
+#include <syslog.h>
+#include <sys/epoll.h>
+#include "SrvCgroup.h"
+#include "SrvProfiler.h"
+#include "SrvHeap.h"
+#include "SrvWatchdog.h"
+#include "SrvSharedConfig.h"
+#include "SrvSpawner.h"
+#include "SrvStandby.h"
+#include "SrvNotify.h"
+#endif
+
+using namespace std;
+
+CSrvRuntime::CSrvRuntime(const SrvParam& SrvPara, const SrvRuntimeHooks& Hooks) : m_SrvPara(SrvPara), m_Hooks(Hooks), m_TaskGraph(SrvPara.vInitTasks),
+    m_bStop(false), m_bRunning(false), m_iReady(0), m_nStarts(0), m_nIdleStops(0)
+#if !defined(_WIN32) && !defined(_WIN64)
+    , m_pOwnEventLoop(Hooks.pEventLoop == nullptr ? new CSrvEventLoop() : nullptr)
+    , m_EventLoop(Hooks.pEventLoop == nullptr ? *m_pOwnEventLoop : *Hooks.pEventLoop)
+    , m_Pressure(m_EventLoop), m_FileWatch(m_EventLoop), m_Depends(m_EventLoop), m_bDependsReady(false), m_iProfilerTimer(-1)
+#endif
+{
+    if (m_Hooks.fnLog == nullptr)
+    {
+        m_Hooks.fnLog = [](SrvLogLevel Level, const string& strMessage)
+        {
+#if defined(_WIN32) || defined(_WIN64)
+            static_cast<void>(Level);
+            OutputDebugStringA(string(strMessage + "\r\n").c_str());
+#else
+            syslog(static_cast<int>(Level), "%s", strMessage.c_str());
+#endif
+        };
+    }
+    if (m_Hooks.fnNow == nullptr)
+        m_Hooks.fnNow = []() { return chrono::steady_clock::now(); };
+    if (m_Hooks.fnIdle == nullptr)
+        m_Hooks.fnIdle = [this]() { Stop(); };
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (m_Hooks.bProcessWide == true)
+        CSrvHeap::Configure(m_SrvPara.nMallocArenaMax, m_SrvPara.vMallopt);
+#endif
+}
+
+CSrvRuntime::~CSrvRuntime()
+{
+    Stop();
+    Wait();
+}
+
+void CSrvRuntime::Prepare()
+{
+    lock_guard<mutex> lock(m_mxState);
+    m_bStop = false;
+    m_bRunning = true;
+    m_iReady = 0;
+    ++m_nStarts;
+}
+
+bool CSrvRuntime::Run()
+{
+    Prepare();
+    return RunService();
+}
+
+bool CSrvRuntime::Start()
+{
+    if (m_thService.joinable() == true)
+    {
+        if (IsStopped() == false)
+            return false;
+        m_thService.join();
+    }
+
+    Prepare();
+    m_thService = thread([this]() { RunService(); });
+    return true;
+}
+
+void CSrvRuntime::Stop()
+{
+    {
+        lock_guard<mutex> lock(m_mxState);
+        m_bStop = true;
+    }
+    m_cvState.notify_all();
+}
+
+void CSrvRuntime::Wait()
+{
+    if (m_thService.joinable() == true && m_thService.get_id() != this_thread::get_id())
+        m_thService.join();
+}
+
+bool CSrvRuntime::WaitReady(chrono::milliseconds tTimeout)
+{
+    unique_lock<mutex> lock(m_mxState);
+    m_cvState.wait_for(lock, tTimeout, [&]() { return m_iReady != 0 || m_bRunning == false; });
+    return m_iReady == 1;
+}
+
+bool CSrvRuntime::IsReady()
+{
+    lock_guard<mutex> lock(m_mxState);
+    return m_iReady == 1;
+}
+
+bool CSrvRuntime::IsStopped()
+{
+    lock_guard<mutex> lock(m_mxState);
+    return m_bRunning == false;
+}
+
+void CSrvRuntime::Reload()
+{
+    if (m_SrvPara.fnSignalCallBack != nullptr)
+    {
+        SRVTRACE_SCOPE("SignalCallBack");
+        m_SrvPara.fnSignalCallBack();
+    }
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (m_Module.Get() != nullptr)
+    {
+        SRVTRACE_SCOPE("ModuleReload");
+        m_Module.Reload();
+    }
+#endif
+}
+
+void CSrvRuntime::Signal(int iSignal)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    if (iSignal == SIGINT)
+        Reload();
+#else
+    if (IsOwnEventLoop() == true)
+        m_EventLoop.PostSignal(iSignal);
+    else    // only this service of the host
+        m_EventLoop.Post([this, iSignal]() { HandleSignal(iSignal); });
+#endif
+}
+
+void CSrvRuntime::SetReady(int iReady)
+{
+    {
+        lock_guard<mutex> lock(m_mxState);
+        m_iReady = iReady;
+        m_tReady = Now();
+    }
+    m_cvState.notify_all();
+}
+
+void CSrvRuntime::GetStats(StatsList& lstStats)
+{
+    lock_guard<mutex> lock(m_mxState);
+    lstStats.emplace_back("starts", to_string(m_nStarts));
+    lstStats.emplace_back("idle_stops", to_string(m_nIdleStops));
+    if (m_iReady == 1)
+    {
+        lstStats.emplace_back("ready_us", to_string(chrono::duration_cast<chrono::microseconds>(m_tReady - m_tStart).count()));
+        lstStats.emplace_back("uptime_s", to_string(chrono::duration_cast<chrono::seconds>(Now() - m_tReady).count()));
+    }
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+void CSrvRuntime::ToggleProfiler()
+{
+    if (CSrvProfiler::IsActive() == false)
+    {
+        if (CSrvProfiler::Start() == false)
+            Log(SrvLogLevel::Warning, "The profiler could not be started");
+        else    // the threads started later get their timer too
+            m_iProfilerTimer = m_EventLoop.AddTimer(chrono::milliseconds(1000), []() { CSrvProfiler::Refresh(); });
+        return;
+    }
+
+    m_EventLoop.RemoveTimer(m_iProfilerTimer);
+    m_iProfilerTimer = -1;
+    if (CSrvProfiler::Stop(m_strProfileFile) == false)
+        Log(SrvLogLevel::Warning, "Profile could not be written to " + m_strProfileFile);
+}
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+bool CSrvRuntime::WaitDependencies()
+{
+    {
+        lock_guard<mutex> lock(m_mxState);
+        m_bDependsReady = false;
+    }
+    if (m_Depends.Start(m_SrvPara.vDependencies, chrono::milliseconds(100), [this]()
+        {
+            {
+                lock_guard<mutex> lock(m_mxState);
+                m_bDependsReady = true;
+            }
+            m_cvState.notify_all();
+        }) == false)
+    {
+        Log(SrvLogLevel::Error, "the dependencies cannot be waited for");
+        return false;
+    }
+
+    bool bDependsReady;
+    bool bStop;
+    {
+        unique_lock<mutex> lock(m_mxState);
+        if (m_bDependsReady == false)
+        {
+            lock.unlock();
+            const string strStatus = "waiting for " + m_Depends.GetMissing();
+            Log(SrvLogLevel::Notice, strStatus);
+            if (m_Hooks.bProcessWide == true)
+                CSrvNotify::Notify("STATUS=" + strStatus);
+            lock.lock();
+        }
+        auto fnDone = [&]() { return m_bDependsReady == true || m_bStop == true; };
+        if (m_SrvPara.nDependencyTimeoutMs > 0)
+            m_cvState.wait_for(lock, chrono::milliseconds(m_SrvPara.nDependencyTimeoutMs), fnDone);
+        else
+            m_cvState.wait(lock, fnDone);
+        bDependsReady = m_bDependsReady;
+        bStop = m_bStop;
+    }
+    if (bDependsReady == false)
+    {
+        if (bStop == true)
+            Log(SrvLogLevel::Notice, "stopped while waiting for " + m_Depends.GetMissing());
+        else
+            Log(SrvLogLevel::Error, "the start was given up, still missing " + m_Depends.GetMissing());
+        m_Depends.Stop();
+    }
+    else if (m_Hooks.bProcessWide == true)
+        CSrvNotify::Notify("STATUS=");
+    return bDependsReady;
+}
+
+void CSrvRuntime::HandleSignal(int iSignal)
+{
+    if (iSignal == SIGHUP)
+        Reload();
+    else if (iSignal == SIGQUIT || iSignal == SIGTERM || iSignal == SIGINT)
+        Stop();
+    else if (iSignal == SIGUSR1)
+    {
+        if (m_strTraceFile.empty() == false && CSrvTrace::Dump(m_strTraceFile) == false)
+            Log(SrvLogLevel::Warning, "Trace could not be written to " + m_strTraceFile);
+    }
+    else if (iSignal == SIGUSR2)
+    {
+        if (m_strStatsFile.empty() == false && CSrvStats::Dump(m_strStatsFile) == false)
+            Log(SrvLogLevel::Warning, "Statistics could not be written to " + m_strStatsFile);
+    }
+    else if (iSignal == CSrvProfiler::GetSignal())
+        ToggleProfiler();
+    else if (iSignal == CSrvHeap::GetSignal())
+        Log(SrvLogLevel::Notice, "malloc_trim released " + to_string(CSrvHeap::Trim()) + " KB");
+}
+#endif
+
+bool CSrvRuntime::RunService()
+{
+    m_tStart = Now();
+#if defined(_WIN32) || defined(_WIN64)
+    CSrvTrace::SetThreadName("Service");
+#else
+    CSrvThreadStats::RegisterThread("Service");
+#endif
+    vector<int> vStatsIds;
+    vStatsIds.push_back(CSrvStats::AddProvider(m_Hooks.strStatsPrefix + "runtime", [this](StatsList& lstStats) { GetStats(lstStats); }));
+    if (m_Hooks.bProcessWide == true)
+        vStatsIds.push_back(CSrvStats::AddProvider("arena", CSrvArena::GetStats));
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    int iHeapTimer{-1};
+    int iThreadStatsTimer{-1};
+    int iIdleTimer{-1};
+    if (m_Hooks.bProcessWide == true)
+    {
+        vStatsIds.push_back(CSrvStats::AddProvider("pressure", CSrvPressure::GetStats));
+        vStatsIds.push_back(CSrvStats::AddProvider("idle", CSrvIdle::GetStats));
+        if (CSrvStandby::IsLocked() == true)
+            vStatsIds.push_back(CSrvStats::AddProvider("standby", CSrvStandby::GetStats));
+        // the cgroups come first, a forked helper would stay in our own cgroup and block the controllers
+        if ((m_SrvPara.vThreadGroups.empty() == false || m_SrvPara.nMemoryHigh > 0) && CSrvCgroup::IsActive() == false)
+        {
+            if (CSrvCgroup::Setup(m_SrvPara.vThreadGroups, m_SrvPara.nMemoryHigh) == false)
+                Log(SrvLogLevel::Warning, CSrvCgroup::IsActive() == true ? "not all cgroup limits could be applied, see the cgroup statistics"
+                    : "cgroups could not be created, is the cgroup delegated (Delegate=yes)?");
+            if (CSrvCgroup::IsActive() == true)
+                vStatsIds.push_back(CSrvStats::AddProvider("cgroup", CSrvCgroup::GetStats));
+        }
+        if (m_SrvPara.nSpawnHelpers > 0)
+        {
+            if (CSrvSpawner::Start(m_SrvPara.nSpawnHelpers, m_EventLoop) == true)
+                vStatsIds.push_back(CSrvStats::AddProvider("spawner", CSrvSpawner::GetStats));
+            else
+                Log(SrvLogLevel::Warning, "the spawn helpers could not be started");
+        }
+        // a new configuration from the master is handled like a SIGHUP, in a host all services reload
+        if (CSrvSharedConfig::GetChannel() >= 0)
+        {
+            m_EventLoop.AddFd(CSrvSharedConfig::GetChannel(), EPOLLIN, [this](uint32_t nEvents)
+            {
+                if (CSrvSharedConfig::Receive() == true)
+                    m_EventLoop.PostSignal(SIGHUP);
+                else if ((nEvents & (EPOLLHUP | EPOLLERR)) != 0)
+                    m_EventLoop.RemoveFd(CSrvSharedConfig::GetChannel());
+            });
+        }
+        if (m_SrvPara.nStallThresholdMs > 0)
+        {
+            CSrvWatchdog::Start(chrono::milliseconds(m_SrvPara.nStallThresholdMs), [this](const string& strReport) { Log(SrvLogLevel::Warning, strReport); });
+            vStatsIds.push_back(CSrvStats::AddProvider("watchdog", CSrvWatchdog::GetStats));
+        }
+
+        vStatsIds.push_back(CSrvStats::AddProvider("heap", CSrvHeap::GetStats));
+        if (m_SrvPara.nMallocTrimIdleMs > 0)
+        {
+            const chrono::milliseconds tInterval(m_SrvPara.nMallocTrimIdleMs);
+            iHeapTimer = m_EventLoop.AddTimer(tInterval, [tInterval]() { CSrvHeap::TrimIfIdle(tInterval); });
+        }
+        if (m_SrvPara.nThreadStatsMs > 0)
+        {
+            m_ThreadStats.Sample();
+            iThreadStatsTimer = m_EventLoop.AddTimer(chrono::milliseconds(m_SrvPara.nThreadStatsMs), [this]() { m_ThreadStats.Sample(); });
+            vStatsIds.push_back(CSrvStats::AddProvider("threads", [this](StatsList& lstStats) { m_ThreadStats.GetStats(lstStats); }));
+        }
+    }
+
+    // free heap memory goes back to the system before the service is asked to shrink
+    auto fnPressure = [this](const SrvPressureTrigger& Trigger)
+    {
+        if (Trigger.strResource.find("memory") != string::npos)
+            CSrvHeap::Trim();
+        if (m_SrvPara.fnPressureCallBack != nullptr)
+            m_SrvPara.fnPressureCallBack(Trigger);
+    };
+    for (const SrvPressureTrigger& Trigger : m_SrvPara.vPressureTriggers)
+        m_Pressure.AddTrigger(Trigger, fnPressure);
+
+    if (IsOwnEventLoop() == true)
+    {
+        for (const int iSignal : { SIGHUP, SIGQUIT, SIGTERM, SIGINT, SIGUSR1, SIGUSR2, CSrvProfiler::GetSignal(), CSrvHeap::GetSignal() })
+            m_EventLoop.OnSignal(iSignal, [this, iSignal]() { HandleSignal(iSignal); });
+        m_EventLoop.Post([]() { CSrvThreadStats::RegisterThread("EventLoop"); });
+        m_EventLoop.Start();
+    }
+#endif
+
+    bool bReady = true;
+#if !defined(_WIN32) && !defined(_WIN64)
+    // the start waits for its sockets, files and ports, instead of failing and being restarted by systemd
+    if (m_SrvPara.vDependencies.empty() == false)
+    {
+        SRVTRACE_SCOPE("WaitDependencies");
+        bReady = WaitDependencies();
+        vStatsIds.push_back(CSrvStats::AddProvider(m_Hooks.strStatsPrefix + "depends", [this](StatsList& lstStats) { m_Depends.GetStats(lstStats); }));
+    }
+#endif
+
+    if (bReady == true && m_TaskGraph.IsEmpty() == false)
+    {
+        SRVTRACE_SCOPE("InitTasks");
+        bReady = m_TaskGraph.RunInit(m_SrvPara.nInitThreads);
+        vStatsIds.push_back(CSrvStats::AddProvider(m_Hooks.strStatsPrefix + "init", [this](StatsList& lstStats) { m_TaskGraph.GetStats(lstStats); }));
+        if (bReady == false)
+            Log(SrvLogLevel::Error, m_TaskGraph.GetError());
+    }
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    // the module runs before fnStartCallBack, which may use it, and stops after fnStopCallBack
+    if (bReady == true && m_SrvPara.strModule.empty() == false)
+    {
+        SRVTRACE_SCOPE("ModuleStart");
+        bReady = m_Module.Load(m_SrvPara.strModule);
+        if (bReady == true)
+            vStatsIds.push_back(CSrvStats::AddProvider(m_Hooks.strStatsPrefix + "module", [this](StatsList& lstStats) { m_Module.GetStats(lstStats); }));
+        else
+            Log(SrvLogLevel::Error, "the module " + m_SrvPara.strModule + " could not be started");
+    }
+#endif
+
+    if (bReady == true && m_SrvPara.fnStartCallBack != nullptr)
+    {
+        SRVTRACE_SCOPE("StartCallBack");
+        m_SrvPara.fnStartCallBack();
+    }
+
+    // the service is ready, a daemon ends the starting process now
+    SetReady(bReady == true ? 1 : -1);
+    if (m_fnReady != nullptr)
+        m_fnReady(bReady);
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    // the idle time counts from here, the start is activity too
+    if (bReady == true && m_Hooks.bProcessWide == true && m_SrvPara.nIdleTimeoutMs > 0)
+    {
+        CSrvIdle::Touch();
+        const chrono::milliseconds tTimeout(m_SrvPara.nIdleTimeoutMs);
+        iIdleTimer = m_EventLoop.AddTimer(min(tTimeout / 4 + chrono::milliseconds(1), chrono::milliseconds(1000)), [this, tTimeout]()
+        {
+            const chrono::milliseconds tIdle = CSrvIdle::GetIdleTime();
+            if (tIdle < tTimeout)
+                return;
+            {
+                lock_guard<mutex> lock(m_mxState);
+                if (m_bStop == true)
+                    return;
+                ++m_nIdleStops;
+            }
+            Log(SrvLogLevel::Notice, "no activity for " + to_string(tIdle.count()) + " ms, stopping");
+            m_Hooks.fnIdle();
+        });
+    }
+
+    // a worker with a shared configuration gets its reload from the master, which watches the files
+    if (bReady == true && m_SrvPara.vWatchFiles.empty() == false && CSrvSharedConfig::GetChannel() < 0)
+    {
+        if (m_FileWatch.Start(m_SrvPara.vWatchFiles, chrono::milliseconds(m_SrvPara.nWatchDebounceMs), [this]()
+            {
+                Log(SrvLogLevel::Notice, "configuration changed, reloading");
+                Reload();
+            }) == true)
+            vStatsIds.push_back(CSrvStats::AddProvider(m_Hooks.strStatsPrefix + "filewatch", [this](StatsList& lstStats) { m_FileWatch.GetStats(lstStats); }));
+        else
+            Log(SrvLogLevel::Warning, "the configuration files cannot be watched");
+    }
+#endif
+
+    if (bReady == true)
+    {
+        {
+            unique_lock<mutex> lock(m_mxState);
+            m_cvState.wait(lock, [&]() { return m_bStop; });
+        }
+        SRVTRACE_INSTANT("StopRequested");
+#if !defined(_WIN32) && !defined(_WIN64)
+        m_FileWatch.Stop();
+#endif
+
+        if (m_SrvPara.fnStopCallBack != nullptr)
+        {
+            SRVTRACE_SCOPE("StopCallBack");
+            m_SrvPara.fnStopCallBack();
+        }
+#if !defined(_WIN32) && !defined(_WIN64)
+        m_Module.Unload();
+#endif
+    }
+
+    if (m_TaskGraph.IsEmpty() == false)
+    {
+        SRVTRACE_SCOPE("ExitTasks");
+        m_TaskGraph.RunExit(m_SrvPara.nInitThreads);
+    }
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (IsOwnEventLoop() == true)
+    {
+        m_EventLoop.Stop();
+        if (CSrvProfiler::IsActive() == true)
+            ToggleProfiler();
+    }
+    if (m_Hooks.bProcessWide == true)
+    {
+        CSrvWatchdog::Stop();
+        CSrvSpawner::Stop();
+    }
+    m_EventLoop.RemoveTimer(iIdleTimer);
+    if (m_Hooks.bProcessWide == true && CSrvSharedConfig::GetChannel() >= 0)
+        m_EventLoop.RemoveFd(CSrvSharedConfig::GetChannel());
+    m_EventLoop.RemoveTimer(iThreadStatsTimer);
+    m_EventLoop.RemoveTimer(iHeapTimer);
+    m_Pressure.RemoveAll();
+    CSrvThreadStats::UnregisterThread();
+#endif
+    for (const int iId : vStatsIds)
+        CSrvStats::RemoveProvider(iId);
+
+    {
+        lock_guard<mutex> lock(m_mxState);
+        m_bRunning = false;
+        m_iReady = 0;
+    }
+    m_cvState.notify_all();
+    return bReady;
+}
@@ -0,0 +1,144 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVRUNTIME_H
+#define SRVRUNTIME_H
+
+#include "Service.h"
+#include "SrvTaskGraph.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvDepends.h"
+#include "SrvEventLoop.h"
+#include "SrvFileWatch.h"
+#include "SrvModule.h"
+#include "SrvPressure.h"
+#include "SrvThreadStats.h"
+#endif
+
+enum class SrvLogLevel : int { Error = 3, Warning = 4, Notice = 5 };     // same values as the syslog priorities
+
+typedef struct
+{
+    std::function<void(SrvLogLevel, const std::string&)> fnLog;         // default: syslog, on Windows OutputDebugString
+    std::function<std::chrono::steady_clock::time_point()> fnNow;       // default: std::chrono::steady_clock::now
+    bool bProcessWide = true;               // cgroups, heap and the process statistics, only one runtime of a process
+    std::string strStatsPrefix;             // put before the statistics sources of this runtime, e.g. "name."
+    std::function<void()> fnIdle;           // called when nIdleTimeoutMs expired, default: Stop
+#if !defined(_WIN32) && !defined(_WIN64)
+    CSrvEventLoop* pEventLoop = nullptr;    // loop of a CSrvHost, the host starts it and handles the signals
+#endif
+}SrvRuntimeHooks;
+
+// The life cycle of a service without a process around it: no fork, no pid file, no signal handlers and no singleton.
+// ServiceMain uses it for the real service, tests and other programs can start and stop it as often as they like.
+class CSrvRuntime
+{
+public:
+    explicit CSrvRuntime(const SrvParam& SrvPara, const SrvRuntimeHooks& Hooks = SrvRuntimeHooks());
+    ~CSrvRuntime();
+    CSrvRuntime() = delete;
+    CSrvRuntime(const CSrvRuntime&) = delete;
+    CSrvRuntime(CSrvRuntime&&) = delete;
+    CSrvRuntime& operator=(const CSrvRuntime&) = delete;
+    CSrvRuntime& operator=(CSrvRuntime&&) = delete;
+
+    // runs the service in the calling thread until Stop is called, false if the init tasks failed
+    bool Run();
+    // runs the service in its own thread, false if it is already running
+    bool Start();
+    // not async signal safe, use Signal in a signal handler
+    void Stop();
+    // waits for the thread started with Start
+    void Wait();
+    // true if the service is ready, false if the start failed, the service stopped or the timeout expired
+    bool WaitReady(std::chrono::milliseconds tTimeout);
+    void Reload();
+
+    // The signals of the process, the program forwards them. On Linux this is async signal safe and the work is done in
+    // the event loop: SIGHUP reloads, SIGQUIT, SIGTERM and SIGINT stop, SIGUSR1 writes the trace and SIGUSR2 the statistics,
+    // CSrvProfiler::GetSignal() starts the profiler and writes the folded stacks at the next one, CSrvHeap::GetSignal()
+    // trims the heap. In a CSrvHost it is not async signal safe, the host gets the signals of the process.
+    // On Windows SIGINT reloads.
+    void Signal(int iSignal);
+#if !defined(_WIN32) && !defined(_WIN64)
+    // does the work of the signal, called in the event loop thread
+    void HandleSignal(int iSignal);
+#endif
+
+    bool IsReady();
+    bool IsStopped();
+    void SetReadyCallBack(std::function<void(bool)> fnReady) { m_fnReady = fnReady; }
+    void SetTraceFile(const std::string& strTraceFile) { m_strTraceFile = strTraceFile; }
+    void SetStatsFile(const std::string& strStatsFile) { m_strStatsFile = strStatsFile; }
+    void SetProfileFile(const std::string& strProfileFile) { m_strProfileFile = strProfileFile; }
+
+    void Log(SrvLogLevel Level, const std::string& strMessage) const { m_Hooks.fnLog(Level, strMessage); }
+    std::chrono::steady_clock::time_point Now() const { return m_Hooks.fnNow(); }
+#if !defined(_WIN32) && !defined(_WIN64)
+    CSrvEventLoop& GetEventLoop() noexcept { return m_EventLoop; }
+    bool IsOwnEventLoop() const noexcept { return m_pOwnEventLoop != nullptr; }
+    CSrvModule& GetModule() noexcept { return m_Module; }
+#endif
+
+private:
+    void Prepare();
+    bool RunService();
+    void SetReady(int iReady);
+    void GetStats(StatsList& lstStats);
+#if !defined(_WIN32) && !defined(_WIN64)
+    void ToggleProfiler();
+    bool WaitDependencies();
+#endif
+
+private:
+    SrvParam                m_SrvPara;
+    SrvRuntimeHooks         m_Hooks;
+    CSrvTaskGraph           m_TaskGraph;
+    std::function<void(bool)> m_fnReady;
+    std::string             m_strTraceFile;
+    std::string             m_strStatsFile;
+    std::string             m_strProfileFile;
+
+    std::mutex              m_mxState;
+    std::condition_variable m_cvState;
+    bool                    m_bStop;
+    bool                    m_bRunning;
+    int                     m_iReady;       // 0 = starting, 1 = ready, -1 = start failed
+    uint64_t                m_nStarts;
+    uint64_t                m_nIdleStops;
+    std::chrono::steady_clock::time_point m_tStart;
+    std::chrono::steady_clock::time_point m_tReady;
+    std::thread             m_thService;
+#if !defined(_WIN32) && !defined(_WIN64)
+    std::unique_ptr<CSrvEventLoop> m_pOwnEventLoop;
+    CSrvEventLoop&          m_EventLoop;
+    CSrvPressure            m_Pressure;
+    CSrvFileWatch           m_FileWatch;
+    CSrvDepends             m_Depends;
+    bool                    m_bDependsReady;
+    CSrvModule              m_Module;
+    CSrvThreadStats         m_ThreadStats;
+    int                     m_iProfilerTimer;
+#endif
+};
+
+#endif // SRVRUNTIME_H
@@ -0,0 +1,128 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvSharedConfig.h"
+#include "SrvFdStore.h"
+
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+namespace
+{
+    shared_ptr<const CSrvConfigGeneration> s_pCurrent;     // only with atomic_load and atomic_store
+    atomic<uint64_t> s_nLastGeneration{0};
+    int s_fdChannel = -1;
+}
+
+CSrvConfigGeneration::~CSrvConfigGeneration()
+{
+    if (m_pData != nullptr)
+        munmap(const_cast<void*>(m_pData), m_nSize);
+}
+
+shared_ptr<const CSrvConfigGeneration> CSrvSharedConfig::Get()
+{
+    return atomic_load(&s_pCurrent);
+}
+
+int CSrvSharedConfig::Publish(const string& strData)
+{
+    // an empty configuration is a memfd with size 0, it is never mapped
+    const int fd = CSrvFdStore::CreateMemFd("config", strData.size());
+    if (fd < 0)
+        return -1;
+    if ((strData.empty() == false && pwrite(fd, strData.data(), strData.size(), 0) != static_cast<ssize_t>(strData.size()))
+        || CSrvFdStore::Seal(fd) == false || Attach(fd, s_nLastGeneration + 1) == false)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool CSrvSharedConfig::Send(int fdChannel, int fdConfig, uint64_t nGeneration)
+{
+    iovec iov{ &nGeneration, sizeof(nGeneration) };
+    char aControl[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = aControl;
+    msg.msg_controllen = sizeof(aControl);
+    cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg);
+    pCmsg->cmsg_level = SOL_SOCKET;
+    pCmsg->cmsg_type = SCM_RIGHTS;
+    pCmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(pCmsg), &fdConfig, sizeof(int));
+    return sendmsg(fdChannel, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == static_cast<ssize_t>(sizeof(nGeneration));
+}
+
+void CSrvSharedConfig::Init(int fdChannel, int fdConfig, uint64_t nGeneration)
+{
+    s_fdChannel = fdChannel;
+    if (fdConfig >= 0)
+        Attach(fdConfig, nGeneration);
+}
+
+int CSrvSharedConfig::GetChannel() noexcept
+{
+    return s_fdChannel;
+}
+
+bool CSrvSharedConfig::Receive()
+{
+    uint64_t nGeneration{0};
+    iovec iov{ &nGeneration, sizeof(nGeneration) };
+    char aControl[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = aControl;
+    msg.msg_controllen = sizeof(aControl);
+    if (recvmsg(s_fdChannel, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC) != static_cast<ssize_t>(sizeof(nGeneration)))
+        return false;
+
+    cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg);
+    if (pCmsg == nullptr || pCmsg->cmsg_level != SOL_SOCKET || pCmsg->cmsg_type != SCM_RIGHTS)
+        return false;
+    int fdConfig{-1};
+    memcpy(&fdConfig, CMSG_DATA(pCmsg), sizeof(int));
+
+    const bool bAttached = Attach(fdConfig, nGeneration);
+    close(fdConfig);
+    return bAttached;
+}
+
+bool CSrvSharedConfig::Attach(int fdConfig, uint64_t nGeneration)
+{
+    // only sealed content can be trusted, nobody can change it under our feet
+    const int iSeals = fcntl(fdConfig, F_GET_SEALS);
+    if (iSeals < 0 || (iSeals & F_SEAL_WRITE) == 0 || nGeneration <= s_nLastGeneration)
+        return false;
+
+    size_t nSize{0};
+    const void* pData = CSrvFdStore::Map(fdConfig, nSize);
+    if (pData == nullptr && lseek(fdConfig, 0, SEEK_END) != 0)
+        return false;
+
+    s_nLastGeneration = nGeneration;
+    atomic_store(&s_pCurrent, shared_ptr<const CSrvConfigGeneration>(make_shared<CSrvConfigGeneration>(nGeneration, pData, nSize)));
+    return true;
+}
+#endif
@@ -0,0 +1,69 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVSHAREDCONFIG_H
+#define SRVSHAREDCONFIG_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// One generation of the configuration, mapped read only from a sealed memfd. It stays valid as long as it is held,
+// a new generation replaces it for the next Get, not for the readers holding it.
+class CSrvConfigGeneration
+{
+public:
+    CSrvConfigGeneration(uint64_t nGeneration, const void* pData, size_t nSize) noexcept : m_nGeneration(nGeneration), m_pData(pData), m_nSize(nSize) {}
+    ~CSrvConfigGeneration();
+    CSrvConfigGeneration() = delete;
+    CSrvConfigGeneration(const CSrvConfigGeneration&) = delete;
+    CSrvConfigGeneration(CSrvConfigGeneration&&) = delete;
+    CSrvConfigGeneration& operator=(const CSrvConfigGeneration&) = delete;
+    CSrvConfigGeneration& operator=(CSrvConfigGeneration&&) = delete;
+
+    uint64_t    GetGeneration() const noexcept { return m_nGeneration; }
+    const char* GetData() const noexcept { return static_cast<const char*>(m_pData); }
+    size_t      GetSize() const noexcept { return m_nSize; }
+
+private:
+    uint64_t    m_nGeneration;
+    const void* m_pData;
+    size_t      m_nSize;
+};
+
+// The configuration parsed once by the master (fnSerializeConfig of the SrvParam struct) and shared with the workers.
+// The master writes it into a sealed memfd and sends the fd over a socket to every worker, the workers map it
+// without a copy. A worker gets a new generation like a SIGHUP.
+class CSrvSharedConfig
+{
+public:
+    // the current generation, nullptr before the first one
+    static std::shared_ptr<const CSrvConfigGeneration> Get();
+
+    // master: a new generation from the serialized configuration, returns the sealed memfd or -1
+    static int  Publish(const std::string& strData);
+    static bool Send(int fdChannel, int fdConfig, uint64_t nGeneration);
+
+    // worker: the socket to the master and the generation the worker was started with
+    static void Init(int fdChannel, int fdConfig, uint64_t nGeneration);
+    static int  GetChannel() noexcept;
+    // reads the next generation from the channel, false if there is none or it can not be mapped
+    static bool Receive();
+
+private:
+    static bool Attach(int fdConfig, uint64_t nGeneration);
+};
+#endif
+
+#endif // SRVSHAREDCONFIG_H
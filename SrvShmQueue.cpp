@@ -0,0 +1,175 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvShmQueue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    // not FUTEX_PRIVATE_FLAG, the futex word is shared between processes
+    void FutexWait(atomic<uint32_t>* pFutex, uint32_t nValue, chrono::milliseconds tTimeout) noexcept
+    {
+        timespec ts{ static_cast<time_t>(tTimeout.count() / 1000), static_cast<long>((tTimeout.count() % 1000) * 1000000) };
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(pFutex), FUTEX_WAIT, nValue, tTimeout.count() < 0 ? nullptr : &ts, nullptr, 0);
+    }
+
+    void FutexWake(atomic<uint32_t>* pFutex, int iCount) noexcept
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(pFutex), FUTEX_WAKE, iCount, nullptr, nullptr, 0);
+    }
+}
+
+CSrvShmQueue::CSrvShmQueue(uint32_t nSlots, uint32_t nMaxMsgSize) : m_pHeader(nullptr), m_pSlots(nullptr), m_nMapSize(0), m_nMask(0), m_nSlotSize(0), m_nMaxMsgSize(nMaxMsgSize)
+{
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "the atomics in the shared memory must be lock free");
+
+    uint64_t nCount = 2;
+    while (nCount < nSlots)
+        nCount <<= 1;
+    m_nMask = nCount - 1;
+    m_nSlotSize = (sizeof(Slot) + nMaxMsgSize + CACHELINE - 1) & ~(CACHELINE - 1);
+    m_nMapSize = sizeof(Header) + nCount * m_nSlotSize;
+
+    void* pMap = mmap(nullptr, m_nMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (pMap == MAP_FAILED)
+        return;
+
+    m_pHeader = new (pMap) Header();
+    m_pHeader->nEnqueue.store(0, memory_order_relaxed);
+    m_pHeader->nDequeue.store(0, memory_order_relaxed);
+    m_pHeader->nFutex.store(0, memory_order_relaxed);
+    m_pHeader->nWaiters.store(0, memory_order_relaxed);
+    m_pSlots = static_cast<uint8_t*>(pMap) + sizeof(Header);
+    for (uint64_t n = 0; n < nCount; ++n)
+    {
+        Slot* pSlot = new (m_pSlots + n * m_nSlotSize) Slot();
+        pSlot->nSeq.store(n, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+}
+
+CSrvShmQueue::~CSrvShmQueue()
+{
+    if (m_pHeader != nullptr)
+        munmap(m_pHeader, m_nMapSize);
+}
+
+bool CSrvShmQueue::TryPush(const void* pData, uint32_t nSize) noexcept
+{
+    if (m_pHeader == nullptr || nSize > m_nMaxMsgSize)
+        return false;
+
+    Slot* pSlot;
+    uint64_t nPos = m_pHeader->nEnqueue.load(memory_order_relaxed);
+    for (;;)
+    {
+        pSlot = GetSlot(nPos);
+        const int64_t nDiff = static_cast<int64_t>(pSlot->nSeq.load(memory_order_acquire) - nPos);
+        if (nDiff == 0)
+        {
+            if (m_pHeader->nEnqueue.compare_exchange_weak(nPos, nPos + 1, memory_order_relaxed) == true)
+                break;
+        }
+        else if (nDiff < 0)
+            return false;   // full
+        else
+            nPos = m_pHeader->nEnqueue.load(memory_order_relaxed);
+    }
+
+    memcpy(GetData(pSlot), pData, nSize);
+    pSlot->nSize = nSize;
+    pSlot->nSeq.store(nPos + 1, memory_order_release);
+
+    m_pHeader->nFutex.fetch_add(1);
+    if (m_pHeader->nWaiters.load() > 0)
+        FutexWake(&m_pHeader->nFutex, 1);
+    return true;
+}
+
+CSrvShmQueue::Slot* CSrvShmQueue::ClaimRead() noexcept
+{
+    if (m_pHeader == nullptr)
+        return nullptr;
+
+    uint64_t nPos = m_pHeader->nDequeue.load(memory_order_relaxed);
+    for (;;)
+    {
+        Slot* pSlot = GetSlot(nPos);
+        const int64_t nDiff = static_cast<int64_t>(pSlot->nSeq.load(memory_order_acquire) - (nPos + 1));
+        if (nDiff == 0)
+        {
+            if (m_pHeader->nDequeue.compare_exchange_weak(nPos, nPos + 1, memory_order_relaxed) == true)
+                return pSlot;
+        }
+        else if (nDiff < 0)
+            return nullptr; // empty
+        else
+            nPos = m_pHeader->nDequeue.load(memory_order_relaxed);
+    }
+}
+
+void CSrvShmQueue::ReleaseRead(Slot* pSlot) noexcept
+{
+    // the sequence is position + 1, the producer of the next round waits for position + slots
+    pSlot->nSeq.store(pSlot->nSeq.load(memory_order_relaxed) + m_nMask, memory_order_release);
+}
+
+int CSrvShmQueue::TryPop(void* pBuffer, uint32_t nBufSize) noexcept
+{
+    Slot* pSlot = ClaimRead();
+    if (pSlot == nullptr)
+        return -1;
+    const uint32_t nSize = pSlot->nSize;
+    memcpy(pBuffer, GetData(pSlot), min(nSize, nBufSize));
+    ReleaseRead(pSlot);
+    return static_cast<int>(nSize);
+}
+
+int CSrvShmQueue::Pop(void* pBuffer, uint32_t nBufSize, chrono::milliseconds tTimeout) noexcept
+{
+    const auto tEnd = chrono::steady_clock::now() + tTimeout;
+    for (;;)
+    {
+        int iSize = TryPop(pBuffer, nBufSize);
+        if (iSize >= 0 || m_pHeader == nullptr)
+            return iSize;
+
+        m_pHeader->nWaiters.fetch_add(1);
+        const uint32_t nValue = m_pHeader->nFutex.load();
+        iSize = TryPop(pBuffer, nBufSize);
+        if (iSize < 0)
+        {
+            chrono::milliseconds tWait(-1);
+            if (tTimeout.count() >= 0)
+                tWait = max(chrono::milliseconds(0), chrono::duration_cast<chrono::milliseconds>(tEnd - chrono::steady_clock::now()));
+            if (tWait.count() != 0)
+                FutexWait(&m_pHeader->nFutex, nValue, tWait);
+        }
+        m_pHeader->nWaiters.fetch_sub(1);
+
+        if (iSize >= 0)
+            return iSize;
+        if (tTimeout.count() >= 0 && chrono::steady_clock::now() >= tEnd)
+            return TryPop(pBuffer, nBufSize);
+    }
+}
+#endif
@@ -0,0 +1,92 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVSHMQUEUE_H
+#define SRVSHMQUEUE_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock free MPMC queue in an anonymous shared mapping. It must be created before the
+// processes are forked, all processes inherit the mapping. Every slot has its own cache line(s),
+// the message is copied into the slot, a consumer reads it directly from the shared memory.
+// Waiting consumers sleep on a futex in the mapping and are woken by the producers.
+class CSrvShmQueue
+{
+public:
+    static constexpr size_t CACHELINE = 64;
+
+    CSrvShmQueue(uint32_t nSlots, uint32_t nMaxMsgSize);   // nSlots is rounded up to a power of 2
+    ~CSrvShmQueue();
+    CSrvShmQueue() = delete;
+    CSrvShmQueue(const CSrvShmQueue&) = delete;
+    CSrvShmQueue(CSrvShmQueue&&) = delete;
+    CSrvShmQueue& operator=(const CSrvShmQueue&) = delete;
+    CSrvShmQueue& operator=(CSrvShmQueue&&) = delete;
+
+    bool IsValid() const noexcept { return m_pHeader != nullptr; }
+    uint32_t GetMaxMsgSize() const noexcept { return m_nMaxMsgSize; }
+
+    // false if the queue is full or the message is too big
+    bool TryPush(const void* pData, uint32_t nSize) noexcept;
+    // returns the size of the message or -1 if the queue is empty, a message bigger than nBufSize is truncated
+    int  TryPop(void* pBuffer, uint32_t nBufSize) noexcept;
+    // waits until a message is available, tTimeout < 0 waits forever
+    int  Pop(void* pBuffer, uint32_t nBufSize, std::chrono::milliseconds tTimeout) noexcept;
+
+    // Zero copy access, fnReader is called with the message in the shared memory
+    template<typename FN>
+    bool TryConsume(FN fnReader) noexcept
+    {
+        Slot* pSlot = ClaimRead();
+        if (pSlot == nullptr)
+            return false;
+        fnReader(static_cast<const void*>(GetData(pSlot)), pSlot->nSize);
+        ReleaseRead(pSlot);
+        return true;
+    }
+
+private:
+    struct alignas(CACHELINE) Header
+    {
+        alignas(CACHELINE) std::atomic<uint64_t> nEnqueue;
+        alignas(CACHELINE) std::atomic<uint64_t> nDequeue;
+        alignas(CACHELINE) std::atomic<uint32_t> nFutex;   // changed by every push, consumers wait on it
+        std::atomic<uint32_t> nWaiters;
+    };
+
+    struct Slot
+    {
+        std::atomic<uint64_t> nSeq;
+        uint32_t              nSize;
+        uint32_t              nReserved;
+    };
+
+    Slot* GetSlot(uint64_t nPos) const noexcept { return reinterpret_cast<Slot*>(m_pSlots + (nPos & m_nMask) * m_nSlotSize); }
+    static uint8_t* GetData(Slot* pSlot) noexcept { return reinterpret_cast<uint8_t*>(pSlot) + sizeof(Slot); }
+    Slot* ClaimRead() noexcept;
+    void  ReleaseRead(Slot* pSlot) noexcept;
+
+private:
+    Header*  m_pHeader;
+    uint8_t* m_pSlots;
+    size_t   m_nMapSize;
+    uint64_t m_nMask;
+    size_t   m_nSlotSize;
+    uint32_t m_nMaxMsgSize;
+};
+#endif
+
+#endif // SRVSHMQUEUE_H
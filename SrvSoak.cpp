@@ -0,0 +1,305 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+// Soak test of the service life cycle: thousands of start, reload and stop cycles of a CSrvRuntime with signal
+// storms in between, the RSS, the open fds and the threads are sampled and must not grow.
+// SrvSoak [-c cycles] [-n cycles-per-runtime] [-r reloads] [-s signals] [-i sample-interval] [-d directory]
+//         [-m max-rss-growth-kb] [-h max-heap-growth-kb] [-f max-fd-growth] [-t max-thread-growth] [-o report-file]
+
+#include "SrvRuntime.h"
+#include "SrvHeap.h"
+#include "SrvSpawner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    struct Sample
+    {
+        uint32_t nCycle;
+        long     nRssKb;        // RssAnon, the pages of the executable paged in late are not a leak
+        long     nHeapKb;       // malloc'ed and not freed, without the fragmentation of the RSS
+        long     nFds;
+        long     nThreads;
+    };
+
+    long CountEntries(const char* szDir)
+    {
+        DIR* pDir = opendir(szDir);
+        if (pDir == nullptr)
+            return -1;
+        long nCount = 0;
+        while (dirent* pEntry = readdir(pDir))
+        {
+            if (pEntry->d_name[0] != '.')
+                ++nCount;
+        }
+        closedir(pDir);
+        return nCount - (string(szDir) == "/proc/self/fd" ? 1 : 0);     // the fd of opendir
+    }
+
+    Sample TakeSample(uint32_t nCycle)
+    {
+        long nRssKb = -1;
+        {
+            ifstream finStatus("/proc/self/status");
+            for (string strLine; getline(finStatus, strLine);)
+            {
+                if (strLine.compare(0, 8, "RssAnon:") == 0)
+                    nRssKb = stol(strLine.substr(8));
+            }
+        }
+        StatsList lstHeap;
+        CSrvHeap::GetStats(lstHeap);
+        long nHeapKb = 0;
+        for (const auto& Value : lstHeap)
+        {
+            if (Value.first == "in_use_bytes" || Value.first == "mmap_bytes")
+                nHeapKb += stol(Value.second) / 1024;
+        }
+        return Sample{ nCycle, nRssKb, nHeapKb, CountEntries("/proc/self/fd"), CountEntries("/proc/self/task") };
+    }
+
+    // least squares slope per 1000 cycles
+    double Slope(const vector<Sample>& vSamples, long Sample::* pValue)
+    {
+        if (vSamples.size() < 2)
+            return 0;
+        double dSumX = 0, dSumY = 0, dSumXY = 0, dSumXX = 0;
+        for (const Sample& S : vSamples)
+        {
+            dSumX += S.nCycle;
+            dSumY += S.*pValue;
+            dSumXY += static_cast<double>(S.nCycle) * S.*pValue;
+            dSumXX += static_cast<double>(S.nCycle) * S.nCycle;
+        }
+        const double dN = static_cast<double>(vSamples.size());
+        const double dDiv = dN * dSumXX - dSumX * dSumX;
+        return dDiv != 0 ? (dN * dSumXY - dSumX * dSumY) / dDiv * 1000 : 0;
+    }
+
+    void AddPercentiles(vector<pair<string, string>>& vReport, const string& strName, vector<uint64_t> vValues)
+    {
+        if (vValues.empty() == true)
+            return;
+        sort(vValues.begin(), vValues.end());
+        for (const int iPercent : { 50, 90, 99 })
+            vReport.emplace_back(strName + ".p" + to_string(iPercent), to_string(vValues[(vValues.size() - 1) * iPercent / 100]));
+        vReport.emplace_back(strName + ".max", to_string(vValues.back()));
+    }
+
+    uint64_t Micros(chrono::steady_clock::time_point tStart)
+    {
+        return static_cast<uint64_t>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - tStart).count());
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const int iHelperExit = CSrvSpawner::HelperMain(argc, argv);
+    if (iHelperExit >= 0)
+        return iHelperExit;
+
+    uint32_t nCycles{2000}, nPerRuntime{10}, nReloads{5}, nSignals{20}, nInterval{100};
+    long nMaxRssKb{2048}, nMaxHeapKb{256}, nMaxFds{0}, nMaxThreads{0};
+    string strDir = "/tmp", strReport;
+
+    for (int iArg = 1; iArg < argc; ++iArg)
+    {
+        const string strArg = argv[iArg];
+        if (strArg.size() != 2 || strArg[0] != '-' || iArg + 1 >= argc)
+        {
+            fprintf(stderr, "usage: %s [-c cycles] [-n cycles-per-runtime] [-r reloads] [-s signals] [-i sample-interval] [-d directory]\n"
+                            "       [-m max-rss-growth-kb] [-h max-heap-growth-kb] [-f max-fd-growth] [-t max-thread-growth] [-o report-file]\n", argv[0]);
+            return 2;
+        }
+        const char* szValue = argv[++iArg];
+        switch (strArg[1])
+        {
+        case 'c': nCycles = static_cast<uint32_t>(strtoul(szValue, nullptr, 10)); break;
+        case 'n': nPerRuntime = max(1ul, strtoul(szValue, nullptr, 10)); break;
+        case 'r': nReloads = static_cast<uint32_t>(strtoul(szValue, nullptr, 10)); break;
+        case 's': nSignals = static_cast<uint32_t>(strtoul(szValue, nullptr, 10)); break;
+        case 'i': nInterval = max(1ul, strtoul(szValue, nullptr, 10)); break;
+        case 'd': strDir = szValue; break;
+        case 'm': nMaxRssKb = strtol(szValue, nullptr, 10); break;
+        case 'h': nMaxHeapKb = strtol(szValue, nullptr, 10); break;
+        case 'f': nMaxFds = strtol(szValue, nullptr, 10); break;
+        case 't': nMaxThreads = strtol(szValue, nullptr, 10); break;
+        case 'o': strReport = szValue; break;
+        default:
+            fprintf(stderr, "unknown option: %s\n", strArg.c_str());
+            return 2;
+        }
+    }
+
+    // a service using most of the runtime: init tasks, a cache, thread statistics, the watchdog, helpers, a watched file
+    const string strConfig = strDir + "/SrvSoak.conf";
+    ofstream(strConfig) << "soak\n";
+    shared_ptr<vector<string>> pCache;
+    mutex mxReloads;
+    condition_variable cvReloads;
+    uint64_t nReloadCount{0};
+    SrvParam SrvPara;
+    SrvPara.szSrvName = L"SrvSoak";
+    SrvPara.vInitTasks.push_back({ "config", {}, []() {}, []() {} });
+    SrvPara.vInitTasks.push_back({ "cache", { "config" }, [&pCache]() { pCache = make_shared<vector<string>>(1000, string(100, 'x')); }, [&pCache]() { pCache.reset(); } });
+    SrvPara.fnStartCallBack = []() {};
+    SrvPara.fnStopCallBack = []() {};
+    SrvPara.fnSignalCallBack = [&]()
+    {
+        pCache = make_shared<vector<string>>(1000, string(100, 'y'));
+        {
+            lock_guard<mutex> lock(mxReloads);
+            ++nReloadCount;
+        }
+        cvReloads.notify_all();
+    };
+    SrvPara.nThreadStatsMs = 100;
+    SrvPara.nStallThresholdMs = 1000;
+    SrvPara.nSpawnHelpers = 1;
+    SrvPara.vWatchFiles = { strConfig };
+
+    SrvRuntimeHooks Hooks;
+    Hooks.fnLog = [](SrvLogLevel Level, const string& strMessage)
+    {
+        if (Level == SrvLogLevel::Error)
+            fprintf(stderr, "%s\n", strMessage.c_str());
+    };
+
+    const int aStorm[] = { SIGUSR1, SIGUSR2, SIGHUP };
+    vector<uint64_t> vStartUs, vReloadUs, vStopUs;
+    vector<Sample> vSamples;
+    // reserved, the harness must not grow the heap itself
+    vStartUs.reserve(nCycles);
+    vReloadUs.reserve(static_cast<size_t>(nCycles) * nReloads);
+    vStopUs.reserve(nCycles);
+    vSamples.reserve(nCycles / nInterval + 1);
+    uint32_t nFailures{0};
+    const auto tBegin = chrono::steady_clock::now();
+
+    unique_ptr<CSrvRuntime> pRuntime;
+    for (uint32_t nCycle = 0; nCycle < nCycles; ++nCycle)
+    {
+        if (nCycle % nPerRuntime == 0)
+        {
+            pRuntime.reset(new CSrvRuntime(SrvPara, Hooks));
+            pRuntime->SetTraceFile(strDir + "/SrvSoak.trace");
+            pRuntime->SetStatsFile(strDir + "/SrvSoak.stats");
+        }
+
+        auto tStart = chrono::steady_clock::now();
+        if (pRuntime->Start() == false || pRuntime->WaitReady(chrono::seconds(10)) == false)
+        {
+            ++nFailures;
+            pRuntime->Stop();
+            pRuntime->Wait();
+            continue;
+        }
+        vStartUs.push_back(Micros(tStart));
+
+        // a reload is done when fnSignalCallBack was called
+        for (uint32_t n = 0; n < nReloads; ++n)
+        {
+            unique_lock<mutex> lock(mxReloads);
+            const uint64_t nBefore = nReloadCount;
+            tStart = chrono::steady_clock::now();
+            pRuntime->Signal(SIGHUP);
+            if (cvReloads.wait_for(lock, chrono::seconds(10), [&]() { return nReloadCount != nBefore; }) == true)
+                vReloadUs.push_back(Micros(tStart));
+            else
+                ++nFailures;
+        }
+
+        // the storm is not waited for, the stop has to cope with what is still queued
+        for (uint32_t n = 0; n < nSignals; ++n)
+            pRuntime->Signal(aStorm[n % (sizeof(aStorm) / sizeof(aStorm[0]))]);
+        auto pSpawned = make_shared<promise<int>>();
+        if (CSrvSpawner::Spawn({ "true" }, [pSpawned](int iStatus) { pSpawned->set_value(iStatus); }) == 0
+            || pSpawned->get_future().wait_for(chrono::seconds(10)) != future_status::ready)
+            ++nFailures;
+
+        tStart = chrono::steady_clock::now();
+        pRuntime->Stop();
+        pRuntime->Wait();
+        vStopUs.push_back(Micros(tStart));
+
+        if ((nCycle + 1) % nInterval == 0 || nCycle + 1 == nCycles)
+        {
+            if ((nCycle + 1) % nPerRuntime == 0)
+                pRuntime.reset();   // the samples are taken without a runtime
+            vSamples.push_back(TakeSample(nCycle + 1));
+            fprintf(stderr, "cycle %u: rss %ld kb, heap %ld kb, %ld fds, %ld threads\n", nCycle + 1, vSamples.back().nRssKb, vSamples.back().nHeapKb, vSamples.back().nFds, vSamples.back().nThreads);
+        }
+    }
+    pRuntime.reset();
+    unlink(strConfig.c_str());
+
+    // the first sample is the baseline, the allocator and the static state have settled by then
+    vector<pair<string, string>> vReport;
+    bool bPassed = nFailures == 0 && vSamples.size() >= 2;
+    vReport.emplace_back("cycles", to_string(nCycles));
+    vReport.emplace_back("reloads_per_cycle", to_string(nReloads));
+    vReport.emplace_back("signals_per_cycle", to_string(nSignals));
+    vReport.emplace_back("failures", to_string(nFailures));
+    vReport.emplace_back("duration_s", to_string(Micros(tBegin) / 1000000));
+    const struct { const char* szName; long Sample::* pValue; long nMax; } aValues[] =
+    {
+        { "rss_kb", &Sample::nRssKb, nMaxRssKb }, { "heap_kb", &Sample::nHeapKb, nMaxHeapKb }, { "fds", &Sample::nFds, nMaxFds }, { "threads", &Sample::nThreads, nMaxThreads }
+    };
+    for (const auto& Value : aValues)
+    {
+        if (vSamples.empty() == true)
+            break;
+        const long nGrowth = vSamples.back().*Value.pValue - vSamples.front().*Value.pValue;
+        vReport.emplace_back(string(Value.szName) + ".baseline", to_string(vSamples.front().*Value.pValue));
+        vReport.emplace_back(string(Value.szName) + ".end", to_string(vSamples.back().*Value.pValue));
+        vReport.emplace_back(string(Value.szName) + ".growth", to_string(nGrowth));
+        vReport.emplace_back(string(Value.szName) + ".per_1000_cycles", to_string(Slope(vSamples, Value.pValue)));
+        if (nGrowth > Value.nMax)
+            bPassed = false;
+    }
+    AddPercentiles(vReport, "start_us", vStartUs);
+    AddPercentiles(vReport, "reload_us", vReloadUs);
+    AddPercentiles(vReport, "stop_us", vStopUs);
+    vReport.emplace_back("result", bPassed == true ? "passed" : "failed");
+
+    FILE* pReport = strReport.empty() == true ? stdout : fopen(strReport.c_str(), "w");
+    if (pReport == nullptr)
+    {
+        fprintf(stderr, "cannot write %s\n", strReport.c_str());
+        return 2;
+    }
+    for (const auto& Line : vReport)
+        fprintf(pReport, "%s %s\n", Line.first.c_str(), Line.second.c_str());
+    if (pReport != stdout)
+        fclose(pReport);
+
+    return bPassed == true ? 0 : 1;
+}
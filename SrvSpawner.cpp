@@ -0,0 +1,463 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvSpawner.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+using namespace std;
+
+namespace
+{
+    constexpr const char* HELPER_ARG = "--srvlib-helper";
+    constexpr int HELPER_FD = 3;                // the socket to the service in the helper
+    constexpr size_t MAX_REQUEST = 65536;
+    // a helper ending earlier after its start failed, it is restarted after 100 ms, 200 ms, ... and then given up
+    constexpr chrono::milliseconds MIN_HELPER_LIFE(1000);
+    constexpr uint32_t MAX_HELPER_FAILS = 5;
+
+    struct Helper
+    {
+        pid_t    nPid{0};
+        int      fdChannel{-1};
+        uint32_t nRunning{0};
+        chrono::steady_clock::time_point tStarted;
+        uint32_t nFails{0};
+        int      iRestartTimer{-1};
+    };
+
+    struct Pending
+    {
+        function<void(int)> fnDone;
+        size_t nHelper;
+    };
+
+    struct SpawnState
+    {
+        mutex                   mxState;
+        CSrvEventLoop*          pEventLoop{nullptr};
+        vector<Helper>          vHelpers;
+        map<uint64_t, Pending>  mapPending;
+        uint64_t                nNextId{1};
+        uint64_t                nSpawned{0};
+        uint64_t                nFailed{0};
+        uint64_t                nHelperRestarts{0};
+    };
+    SpawnState s_State;
+
+    void OnReply(size_t nHelper, uint32_t nEvents);
+
+    // call with mxState locked
+    bool StartHelper(size_t nHelper)
+    {
+        int fdPair[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fdPair) != 0)
+            return false;
+        if (fdPair[1] == HELPER_FD)
+        {   // dup2 to itself would keep the close on exec flag
+            const int fdMoved = fcntl(fdPair[1], F_DUPFD_CLOEXEC, HELPER_FD + 1);
+            close(fdPair[1]);
+            fdPair[1] = fdMoved;
+        }
+
+        posix_spawn_file_actions_t Actions;
+        posix_spawn_file_actions_init(&Actions);
+        posix_spawn_file_actions_adddup2(&Actions, fdPair[1], HELPER_FD);
+        posix_spawnattr_t Attr;
+        posix_spawnattr_init(&Attr);
+        sigset_t sigEmpty, sigAll;
+        sigemptyset(&sigEmpty);
+        sigfillset(&sigAll);
+        posix_spawnattr_setsigmask(&Attr, &sigEmpty);
+        posix_spawnattr_setsigdefault(&Attr, &sigAll);
+        posix_spawnattr_setflags(&Attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+        char szExe[] = "/proc/self/exe";
+        string strArg(HELPER_ARG);
+        char* argv[] = { szExe, &strArg[0], nullptr };
+        pid_t nPid{0};
+        const int iError = posix_spawn(&nPid, szExe, &Actions, &Attr, argv, environ);
+        posix_spawn_file_actions_destroy(&Actions);
+        posix_spawnattr_destroy(&Attr);
+        close(fdPair[1]);
+        if (iError != 0 || fdPair[1] < 0)
+        {
+            close(fdPair[0]);
+            return false;
+        }
+
+        Helper& H = s_State.vHelpers[nHelper];
+        H.nPid = nPid;
+        H.fdChannel = fdPair[0];
+        H.nRunning = 0;
+        H.tStarted = chrono::steady_clock::now();
+        s_State.pEventLoop->AddFd(H.fdChannel, EPOLLIN, [nHelper](uint32_t nEvents) { OnReply(nHelper, nEvents); });
+        return true;
+    }
+
+    // call with mxState locked, the callbacks of the requests that are lost are returned
+    void StopHelper(size_t nHelper, vector<function<void(int)>>& vLost)
+    {
+        Helper& H = s_State.vHelpers[nHelper];
+        if (H.iRestartTimer >= 0)
+        {
+            s_State.pEventLoop->RemoveTimer(H.iRestartTimer);
+            H.iRestartTimer = -1;
+        }
+        if (H.fdChannel >= 0)
+        {
+            s_State.pEventLoop->RemoveFd(H.fdChannel);
+            close(H.fdChannel);     // the helper ends when its programs have ended
+            H.fdChannel = -1;
+        }
+        for (auto itPending = s_State.mapPending.begin(); itPending != s_State.mapPending.end();)
+        {
+            if (itPending->second.nHelper == nHelper)
+            {
+                vLost.push_back(itPending->second.fnDone);
+                itPending = s_State.mapPending.erase(itPending);
+            }
+            else
+                ++itPending;
+        }
+        H.nRunning = 0;
+    }
+
+    void RestartHelper(size_t nHelper)
+    {
+        lock_guard<mutex> lock(s_State.mxState);
+        if (nHelper >= s_State.vHelpers.size() || s_State.vHelpers[nHelper].iRestartTimer < 0)
+            return;     // stopped in the meantime
+        s_State.vHelpers[nHelper].iRestartTimer = -1;
+        StartHelper(nHelper);
+    }
+
+    void OnReply(size_t nHelper, uint32_t nEvents)
+    {
+        vector<pair<function<void(int)>, int>> vDone;
+        vector<function<void(int)>> vLost;
+        {
+            lock_guard<mutex> lock(s_State.mxState);
+            if (nHelper >= s_State.vHelpers.size() || s_State.vHelpers[nHelper].fdChannel < 0)
+                return;
+            Helper& H = s_State.vHelpers[nHelper];
+
+            char aReply[sizeof(uint64_t) + sizeof(int32_t)];
+            ssize_t nRead;
+            while ((nRead = recv(H.fdChannel, aReply, sizeof(aReply), MSG_DONTWAIT)) == static_cast<ssize_t>(sizeof(aReply)))
+            {
+                uint64_t nId;
+                int32_t iStatus;
+                memcpy(&nId, aReply, sizeof(nId));
+                memcpy(&iStatus, aReply + sizeof(nId), sizeof(iStatus));
+                auto itPending = s_State.mapPending.find(nId);
+                if (itPending == s_State.mapPending.end())
+                    continue;
+                vDone.emplace_back(itPending->second.fnDone, iStatus);
+                s_State.mapPending.erase(itPending);
+                if (H.nRunning > 0)
+                    --H.nRunning;
+            }
+
+            // the helper is gone, the running programs are lost, a new helper takes over
+            if (nRead == 0 || (nRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK) || (nEvents & (EPOLLHUP | EPOLLERR)) != 0)
+            {
+                const pid_t nPid = H.nPid;
+                StopHelper(nHelper, vLost);
+                waitpid(nPid, nullptr, 0);
+                ++s_State.nHelperRestarts;
+
+                // a helper that ends right after its start, e.g. HelperMain is not called first, is not restarted at once.
+                // It stays unavailable (fdChannel -1) when it failed too often.
+                H.nFails = chrono::steady_clock::now() - H.tStarted < MIN_HELPER_LIFE ? H.nFails + 1 : 0;
+                if (H.nFails == 0)
+                    StartHelper(nHelper);
+                else if (H.nFails <= MAX_HELPER_FAILS)
+                    H.iRestartTimer = s_State.pEventLoop->AddTimer(chrono::milliseconds(100) * (1 << (H.nFails - 1)), [nHelper]() { RestartHelper(nHelper); }, false);
+                else
+                    syslog(LOG_ERR, "spawner: helper %zu ended %u times right after its start, it is not restarted", nHelper, H.nFails);
+            }
+        }
+
+        for (auto& Done : vDone)
+        {
+            if (Done.first != nullptr)
+                Done.first(Done.second);
+        }
+        for (auto& fnDone : vLost)
+        {
+            if (fnDone != nullptr)
+                fnDone(-1);
+        }
+    }
+
+    void SendReply(uint64_t nId, int32_t iStatus)
+    {
+        char aReply[sizeof(uint64_t) + sizeof(int32_t)];
+        memcpy(aReply, &nId, sizeof(nId));
+        memcpy(aReply + sizeof(nId), &iStatus, sizeof(iStatus));
+        send(HELPER_FD, aReply, sizeof(aReply), MSG_NOSIGNAL);
+    }
+}
+
+bool CSrvSpawner::Start(uint32_t nHelpers, CSrvEventLoop& EventLoop)
+{
+    lock_guard<mutex> lock(s_State.mxState);
+    if (s_State.vHelpers.empty() == false || nHelpers == 0)
+        return false;
+
+    s_State.pEventLoop = &EventLoop;
+    s_State.vHelpers.resize(nHelpers);
+    for (size_t n = 0; n < nHelpers; ++n)
+    {
+        if (StartHelper(n) == false)
+            return false;
+    }
+    return true;
+}
+
+void CSrvSpawner::Stop()
+{
+    vector<function<void(int)>> vLost;
+    vector<pid_t> vPids;
+    {
+        lock_guard<mutex> lock(s_State.mxState);
+        for (size_t n = 0; n < s_State.vHelpers.size(); ++n)
+        {
+            StopHelper(n, vLost);
+            vPids.push_back(s_State.vHelpers[n].nPid);
+        }
+        s_State.vHelpers.clear();
+        s_State.pEventLoop = nullptr;
+    }
+
+    // the helpers end when they see the closed socket, a helper that still waits for a program is not waited for
+    for (int n = 0; n < 100 && vPids.empty() == false; ++n)
+    {
+        for (auto itPid = vPids.begin(); itPid != vPids.end();)
+            itPid = waitpid(*itPid, nullptr, WNOHANG) != 0 ? vPids.erase(itPid) : itPid + 1;
+        if (vPids.empty() == false)
+            usleep(1000);
+    }
+    for (auto& fnDone : vLost)
+    {
+        if (fnDone != nullptr)
+            fnDone(-1);
+    }
+}
+
+bool CSrvSpawner::IsActive() noexcept
+{
+    lock_guard<mutex> lock(s_State.mxState);
+    return s_State.vHelpers.empty() == false;
+}
+
+uint64_t CSrvSpawner::Spawn(const vector<string>& vArgs, function<void(int)> fnDone, int fdOut, int fdErr)
+{
+    if (vArgs.empty() == true)
+        return 0;
+
+    // id, then the arguments, each ends with a 0
+    string strRequest(sizeof(uint64_t), '\0');
+    for (const string& strArg : vArgs)
+        strRequest.append(strArg.c_str(), strArg.size() + 1);
+    if (strRequest.size() > MAX_REQUEST)
+        return 0;
+
+    lock_guard<mutex> lock(s_State.mxState);
+    size_t nHelper = s_State.vHelpers.size();
+    for (size_t n = 0; n < s_State.vHelpers.size(); ++n)
+    {
+        const Helper& H = s_State.vHelpers[n];
+        if (H.fdChannel >= 0 && (nHelper == s_State.vHelpers.size() || H.nRunning < s_State.vHelpers[nHelper].nRunning))
+            nHelper = n;
+    }
+    if (nHelper == s_State.vHelpers.size())
+        return 0;
+    Helper& H = s_State.vHelpers[nHelper];
+
+    const uint64_t nId = s_State.nNextId++;
+    memcpy(&strRequest[0], &nId, sizeof(nId));
+    iovec iov{ &strRequest[0], strRequest.size() };
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    // stdout and stderr go with the request, always both, -1 is /dev/null
+    const int fdNull = (fdOut < 0 || fdErr < 0) ? open("/dev/null", O_WRONLY | O_CLOEXEC) : -1;
+    const int aFds[2] = { fdOut >= 0 ? fdOut : fdNull, fdErr >= 0 ? fdErr : fdNull };
+    char aControl[CMSG_SPACE(sizeof(aFds))] = {};
+    if (aFds[0] >= 0 && aFds[1] >= 0)
+    {
+        msg.msg_control = aControl;
+        msg.msg_controllen = sizeof(aControl);
+        cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg);
+        pCmsg->cmsg_level = SOL_SOCKET;
+        pCmsg->cmsg_type = SCM_RIGHTS;
+        pCmsg->cmsg_len = CMSG_LEN(sizeof(aFds));
+        memcpy(CMSG_DATA(pCmsg), aFds, sizeof(aFds));
+    }
+    const bool bSent = sendmsg(H.fdChannel, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == static_cast<ssize_t>(strRequest.size());
+    if (fdNull >= 0)
+        close(fdNull);
+    if (bSent == false)
+    {
+        ++s_State.nFailed;
+        return 0;
+    }
+
+    ++H.nRunning;
+    ++s_State.nSpawned;
+    s_State.mapPending.emplace(nId, Pending{ fnDone, nHelper });
+    return nId;
+}
+
+int CSrvSpawner::HelperMain(int argc, char* argv[])
+{
+    if (argc < 2 || strcmp(argv[1], HELPER_ARG) != 0)
+        return -1;
+
+    // a daemon has closed stdin, stdout and stderr, the fds we get must not end up there
+    int fdNull;
+    while ((fdNull = open("/dev/null", O_RDWR)) >= 0 && fdNull <= STDERR_FILENO);
+    if (fdNull > STDERR_FILENO)
+        close(fdNull);
+    fcntl(HELPER_FD, F_SETFD, FD_CLOEXEC);
+
+    // SIGCHLD comes through a signalfd, the children get an empty mask back
+    sigset_t sigChild, sigEmpty;
+    sigemptyset(&sigChild);
+    sigemptyset(&sigEmpty);
+    sigaddset(&sigChild, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigChild, nullptr);
+    const int fdSignal = signalfd(-1, &sigChild, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fdSignal < 0)
+        return EXIT_FAILURE;
+
+    map<pid_t, uint64_t> mapRunning;
+    vector<char> vRequest(MAX_REQUEST);
+    bool bOpen = true;
+    while (bOpen == true || mapRunning.empty() == false)
+    {
+        pollfd fds[2] = { { fdSignal, POLLIN, 0 }, { bOpen == true ? HELPER_FD : -1, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0)
+            continue;
+
+        if (fds[1].revents != 0)
+        {
+            iovec iov{ vRequest.data(), vRequest.size() };
+            char aControl[CMSG_SPACE(sizeof(int) * 2)] = {};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = aControl;
+            msg.msg_controllen = sizeof(aControl);
+            const ssize_t nRead = recvmsg(HELPER_FD, &msg, MSG_CMSG_CLOEXEC);
+            if (nRead <= 0)
+            {
+                if (nRead == 0 || errno != EINTR)
+                    bOpen = false;      // the service is gone, we end after our programs
+            }
+            else if (nRead > static_cast<ssize_t>(sizeof(uint64_t)))
+            {
+                uint64_t nId;
+                memcpy(&nId, vRequest.data(), sizeof(nId));
+                vRequest[nRead - 1] = '\0';
+                vector<char*> vArgv;
+                for (ssize_t nPos = sizeof(uint64_t); nPos < nRead; nPos += static_cast<ssize_t>(strlen(&vRequest[nPos])) + 1)
+                    vArgv.push_back(&vRequest[nPos]);
+                vArgv.push_back(nullptr);
+
+                int aFds[2] = { -1, -1 };
+                cmsghdr* pCmsg = CMSG_FIRSTHDR(&msg);
+                if (pCmsg != nullptr && pCmsg->cmsg_type == SCM_RIGHTS && pCmsg->cmsg_len == CMSG_LEN(sizeof(aFds)))
+                    memcpy(aFds, CMSG_DATA(pCmsg), sizeof(aFds));
+
+                const pid_t nPid = fork();
+                if (nPid == 0)
+                {
+                    sigprocmask(SIG_SETMASK, &sigEmpty, nullptr);
+                    const int fdIn = open("/dev/null", O_RDONLY);
+                    if (fdIn >= 0 && fdIn != STDIN_FILENO)
+                    {
+                        dup2(fdIn, STDIN_FILENO);
+                        close(fdIn);
+                    }
+                    if (aFds[0] >= 0)
+                        dup2(aFds[0], STDOUT_FILENO);
+                    if (aFds[1] >= 0)
+                        dup2(aFds[1], STDERR_FILENO);
+                    execvp(vArgv[0], vArgv.data());
+                    _exit(127);
+                }
+                for (const int fd : aFds)
+                {
+                    if (fd >= 0)
+                        close(fd);
+                }
+                if (nPid < 0)
+                    SendReply(nId, -1);
+                else
+                    mapRunning[nPid] = nId;
+            }
+        }
+
+        if (fds[0].revents != 0)
+        {
+            signalfd_siginfo si;
+            while (read(fdSignal, &si, sizeof(si)) == sizeof(si));
+            int iStatus{0};
+            pid_t nPid;
+            while ((nPid = waitpid(-1, &iStatus, WNOHANG)) > 0)
+            {
+                auto itRunning = mapRunning.find(nPid);
+                if (itRunning == mapRunning.end())
+                    continue;
+                SendReply(itRunning->second, iStatus);
+                mapRunning.erase(itRunning);
+            }
+        }
+    }
+    close(fdSignal);
+    return 0;
+}
+
+void CSrvSpawner::GetStats(StatsList& lstStats)
+{
+    lock_guard<mutex> lock(s_State.mxState);
+    uint32_t nRunning{0};
+    for (const Helper& H : s_State.vHelpers)
+        nRunning += H.nRunning;
+    lstStats.emplace_back("helpers", to_string(s_State.vHelpers.size()));
+    lstStats.emplace_back("running", to_string(nRunning));
+    lstStats.emplace_back("spawned", to_string(s_State.nSpawned));
+    lstStats.emplace_back("failed", to_string(s_State.nFailed));
+    lstStats.emplace_back("helper_restarts", to_string(s_State.nHelperRestarts));
+}
+#endif
@@ -0,0 +1,48 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVSPAWNER_H
+#define SRVSPAWNER_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvEventLoop.h"
+#include "SrvStats.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Runs external programs without forking the (big, multi threaded) service. Small helper processes are started
+// with posix_spawn from /proc/self/exe, they get the command lines over a socket, fork themselves and report the
+// exit status back. The callbacks are called in the event loop thread. ServiceMain calls HelperMain first,
+// programs using CSrvRuntime directly must do that at the start of main. A helper ending right after its start is
+// restarted with a growing delay and given up after 5 tries.
+class CSrvSpawner
+{
+public:
+    static bool Start(uint32_t nHelpers, CSrvEventLoop& EventLoop);
+    static void Stop();
+    static bool IsActive() noexcept;
+
+    // returns an id > 0, or 0 if no helper could take it. fnDone gets the wait status (WIFEXITED, WEXITSTATUS, ...),
+    // -1 if the helper could not start the program, exit code 127 if it is not found. The program gets /dev/null
+    // as stdin, fdOut and fdErr as stdout and stderr (/dev/null for -1).
+    static uint64_t Spawn(const std::vector<std::string>& vArgs, std::function<void(int iStatus)> fnDone, int fdOut = -1, int fdErr = -1);
+
+    // in a helper process it runs the helper and returns its exit code, otherwise -1
+    static int  HelperMain(int argc, char* argv[]);
+    static void GetStats(StatsList& lstStats);
+};
+#endif
+
+#endif // SRVSPAWNER_H
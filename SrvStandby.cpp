@@ -0,0 +1,228 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvStandby.h"
+#include "SrvNotify.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/file.h>
+
+using namespace std;
+
+namespace
+{
+    struct StandbyState
+    {
+        mutex               mxState;
+        int                 fdLock{-1};
+        bool                bStandby{false};    // this instance waited for the lock and took over
+        bool                bReady{false};
+        chrono::steady_clock::time_point tLocked;
+        int64_t             nWaitedMs{0};
+        int64_t             nTakeOverUs{0};
+    };
+    StandbyState s_State;
+
+    int s_fdCancel = -1;
+
+    // a stop signal is kept in the eventfd, it is not lost if it comes before the wait
+    void CancelHandler(int)
+    {
+        const int iErrno = errno;
+        const uint64_t nOne = 1;
+        if (write(s_fdCancel, &nOne, sizeof(nOne)) < 0)
+            errno = iErrno;     // Counter is already full, we are cancelled anyway
+        errno = iErrno;
+    }
+
+    // interrupts the flock of the helper thread, installed without SA_RESTART
+    void WakeHandler(int)
+    {
+    }
+
+    int GetWakeSignal() noexcept
+    {
+        return SIGRTMIN + 4;
+    }
+
+    // blocks until the lock is ours, false if a stop signal came first. The flock runs in a helper thread, this
+    // thread waits for the lock and the stop signals together.
+    bool WaitForLock(int fdLock)
+    {
+        s_fdCancel = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        const int fdLocked = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (s_fdCancel < 0 || fdLocked < 0)
+        {
+            syslog(LOG_ERR, "standby: %s", strerror(errno));
+            for (const int fd : { s_fdCancel, fdLocked })
+            {
+                if (fd >= 0)
+                    close(fd);
+            }
+            s_fdCancel = -1;
+            return false;
+        }
+
+        const int aSignals[] = { SIGQUIT, SIGTERM, SIGINT, GetWakeSignal() };
+        struct sigaction aOld[4];
+        for (size_t n = 0; n < 4; ++n)
+        {
+            struct sigaction sa{};
+            sa.sa_handler = aSignals[n] == GetWakeSignal() ? WakeHandler : CancelHandler;
+            sigemptyset(&sa.sa_mask);
+            sigaction(aSignals[n], &sa, &aOld[n]);
+        }
+
+        atomic<bool> bCancel{false};
+        int iLocked = -1;
+        thread thLock([&]()
+        {
+            int iRet;
+            while ((iRet = flock(fdLock, LOCK_EX)) != 0 && errno == EINTR && bCancel == false);
+            iLocked = iRet;
+            const uint64_t nOne = 1;
+            if (write(fdLocked, &nOne, sizeof(nOne)) < 0)
+                return;
+        });
+
+        pollfd aFds[2] = { { fdLocked, POLLIN, 0 }, { s_fdCancel, POLLIN, 0 } };
+        while (poll(aFds, 2, -1) < 0 && errno == EINTR);
+        if ((aFds[1].revents & POLLIN) != 0)
+        {   // the helper may not be in flock yet when the signal comes, so it is repeated until the helper returned
+            bCancel = true;
+            pollfd Locked{ fdLocked, POLLIN, 0 };
+            do
+                pthread_kill(thLock.native_handle(), GetWakeSignal());
+            while (poll(&Locked, 1, 10) <= 0);
+        }
+        thLock.join();
+
+        for (size_t n = 0; n < 4; ++n)
+            sigaction(aSignals[n], &aOld[n], nullptr);
+        close(fdLocked);
+        close(s_fdCancel);
+        s_fdCancel = -1;
+        // a lock taken after the stop signal is released with the close of the lock file
+        return iLocked == 0 && bCancel == false;
+    }
+}
+
+bool CSrvStandby::Lock(const string& strLockFile, function<void()> fnWarmUp, function<void()> fnStandby)
+{
+    const int fdLock = open(strLockFile.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fdLock < 0)
+    {
+        syslog(LOG_ERR, "lock file %s: %s", strLockFile.c_str(), strerror(errno));
+        return false;
+    }
+
+    if (fnWarmUp != nullptr)
+    {
+        try
+        {
+            fnWarmUp();
+        }
+        catch (const exception& ex)
+        {
+            syslog(LOG_ERR, "warm-up failed: %s", ex.what());
+            close(fdLock);
+            return false;
+        }
+    }
+
+    bool bStandby = false;
+    const auto tWaitStart = chrono::steady_clock::now();
+    if (flock(fdLock, LOCK_EX | LOCK_NB) != 0)
+    {
+        if (errno != EWOULDBLOCK)
+        {
+            syslog(LOG_ERR, "lock file %s: %s", strLockFile.c_str(), strerror(errno));
+            close(fdLock);
+            return false;
+        }
+
+        bStandby = true;
+        syslog(LOG_NOTICE, "standby, the active instance holds %s", strLockFile.c_str());
+        CSrvNotify::Notify("STATUS=standby");
+        if (fnStandby != nullptr)
+            fnStandby();
+        if (WaitForLock(fdLock) == false)
+        {
+            syslog(LOG_NOTICE, "standby stopped");
+            close(fdLock);
+            return false;
+        }
+    }
+
+    // the pid in the file is for humans, the lock is what counts
+    const string strPid = to_string(getpid()) + "\n";
+    if (ftruncate(fdLock, 0) != 0 || pwrite(fdLock, strPid.c_str(), strPid.size(), 0) < 0)
+        syslog(LOG_WARNING, "lock file %s: %s", strLockFile.c_str(), strerror(errno));
+
+    lock_guard<mutex> lock(s_State.mxState);
+    s_State.fdLock = fdLock;
+    s_State.bStandby = bStandby;
+    s_State.bReady = false;
+    s_State.tLocked = chrono::steady_clock::now();
+    s_State.nWaitedMs = bStandby == true ? chrono::duration_cast<chrono::milliseconds>(s_State.tLocked - tWaitStart).count() : 0;
+    if (bStandby == true)
+        syslog(LOG_NOTICE, "taking over after %lld ms as standby", static_cast<long long>(s_State.nWaitedMs));
+    return true;
+}
+
+bool CSrvStandby::IsLocked() noexcept
+{
+    lock_guard<mutex> lock(s_State.mxState);
+    return s_State.fdLock >= 0;
+}
+
+void CSrvStandby::SetReady()
+{
+    lock_guard<mutex> lock(s_State.mxState);
+    if (s_State.fdLock < 0 || s_State.bReady == true)
+        return;
+    s_State.bReady = true;
+    s_State.nTakeOverUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - s_State.tLocked).count();
+    if (s_State.bStandby == true)
+        syslog(LOG_NOTICE, "took over, ready %lld us after the lock", static_cast<long long>(s_State.nTakeOverUs));
+}
+
+void CSrvStandby::Detach() noexcept
+{
+    // after fork only this thread exists, the mutex is not needed
+    if (s_State.fdLock >= 0)
+        close(s_State.fdLock);
+    s_State.fdLock = -1;
+}
+
+void CSrvStandby::GetStats(StatsList& lstStats)
+{
+    lock_guard<mutex> lock(s_State.mxState);
+    lstStats.emplace_back("took_over", s_State.bStandby == true ? "1" : "0");
+    lstStats.emplace_back("waited_ms", to_string(s_State.nWaitedMs));
+    lstStats.emplace_back("takeover_us", to_string(s_State.nTakeOverUs));
+}
+#endif
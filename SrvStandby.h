@@ -0,0 +1,41 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVSTANDBY_H
+#define SRVSTANDBY_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvStats.h"
+
+#include <functional>
+#include <string>
+
+// Active and hot standby instance of a service. Both run the warm-up and then take the flock of the same lock file,
+// the one that does not get it is the standby and waits in flock. The kernel releases the lock the moment the
+// active process ends, however it ends, and the standby starts the service at once, it is already warm.
+class CSrvStandby
+{
+public:
+    // runs fnWarmUp and takes the lock. If it is held by the active instance, fnStandby is called and it waits for
+    // the lock. false if the warm-up threw, the lock file cannot be opened or SIGQUIT, SIGTERM or SIGINT came first.
+    static bool Lock(const std::string& strLockFile, std::function<void()> fnWarmUp, std::function<void()> fnStandby);
+    static bool IsLocked() noexcept;
+    // the service is ready, the end of the take over
+    static void SetReady();
+    // in a forked child, closes the lock fd without releasing the lock of the parent
+    static void Detach() noexcept;
+
+    static void GetStats(StatsList& lstStats);
+};
+#endif
+
+#endif // SRVSTANDBY_H
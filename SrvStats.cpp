@@ -0,0 +1,82 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#include "SrvStats.h"
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+namespace
+{
+    struct StatsRegistry
+    {
+        mutex mxProvider;
+        int   iNextId{1};
+        map<int, pair<string, function<void(StatsList&)>>> mapProvider;
+    };
+
+    StatsRegistry& GetRegistry()
+    {
+        static StatsRegistry Registry;
+        return Registry;
+    }
+}
+
+int CSrvStats::AddProvider(const string& strSource, function<void(StatsList&)> fnProvider)
+{
+    StatsRegistry& Registry = GetRegistry();
+    lock_guard<mutex> lock(Registry.mxProvider);
+    const int iId = Registry.iNextId++;
+    Registry.mapProvider.emplace(iId, make_pair(strSource, move(fnProvider)));
+    return iId;
+}
+
+void CSrvStats::RemoveProvider(int iId)
+{
+    StatsRegistry& Registry = GetRegistry();
+    lock_guard<mutex> lock(Registry.mxProvider);
+    Registry.mapProvider.erase(iId);
+}
+
+string CSrvStats::Collect()
+{
+    string strStats;
+    StatsRegistry& Registry = GetRegistry();
+    lock_guard<mutex> lock(Registry.mxProvider);
+    for (auto& itProvider : Registry.mapProvider)
+    {
+        StatsList lstStats;
+        itProvider.second.second(lstStats);
+        for (auto& itStat : lstStats)
+            strStats += itProvider.second.first + "." + itStat.first + " " + itStat.second + "\n";
+    }
+    return strStats;
+}
+
+bool CSrvStats::Dump(const string& strFileName)
+{
+    const string strStats = Collect();
+    const string strTmpFile = strFileName + ".tmp";
+    FILE* fp = fopen(strTmpFile.c_str(), "w");
+    if (fp == nullptr)
+        return false;
+    const bool bOk = fwrite(strStats.c_str(), 1, strStats.size(), fp) == strStats.size();
+    if (fclose(fp) != 0 || bOk == false)
+    {
+        remove(strTmpFile.c_str());
+        return false;
+    }
+    return rename(strTmpFile.c_str(), strFileName.c_str()) == 0;
+}
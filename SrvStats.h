@@ -0,0 +1,34 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVSTATS_H
+#define SRVSTATS_H
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<std::string, std::string>> StatsList;
+
+// Registry of the statistic sources of the library (and the service), written as "<source>.<key> <value>" lines
+class CSrvStats
+{
+public:
+    static int  AddProvider(const std::string& strSource, std::function<void(StatsList&)> fnProvider);
+    static void RemoveProvider(int iId);
+
+    static std::string Collect();
+    static bool Dump(const std::string& strFileName);
+};
+
+#endif // SRVSTATS_H
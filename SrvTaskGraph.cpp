@@ -0,0 +1,201 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#include "SrvTaskGraph.h"
+#include "SrvTrace.h"
+#include "SrvArena.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <thread>
+
+using namespace std;
+
+CSrvTaskGraph::CSrvTaskGraph(const vector<SrvTask>& vTasks) : m_vTasks(vTasks), m_vDepends(vTasks.size()), m_vState(vTasks.size())
+{
+    for (size_t n = 0; n < m_vTasks.size(); ++n)
+    {
+        // the trace may be written after the graph is gone
+        m_vState[n].szTraceName = CSrvTrace::Intern(m_vTasks[n].strName);
+        for (const string& strDepend : m_vTasks[n].vDependsOn)
+        {
+            auto itTask = find_if(m_vTasks.begin(), m_vTasks.end(), [&](const SrvTask& Task) { return Task.strName == strDepend; });
+            if (itTask == m_vTasks.end())
+                m_strGraphError += "task " + m_vTasks[n].strName + " depends on the unknown task " + strDepend + "\n";
+            else
+                m_vDepends[n].push_back(static_cast<size_t>(itTask - m_vTasks.begin()));
+        }
+    }
+}
+
+bool CSrvTaskGraph::RunInit(uint32_t nThreads)
+{
+    m_strError = m_strGraphError;
+    if (m_strError.empty() == false)
+        return false;
+    return Run(false, nThreads);
+}
+
+void CSrvTaskGraph::RunExit(uint32_t nThreads)
+{
+    Run(true, nThreads);
+}
+
+bool CSrvTaskGraph::Run(bool bExit, uint32_t nThreads)
+{
+    const auto tStart = chrono::steady_clock::now();
+    const size_t nCount = m_vTasks.size();
+
+    // for the init a task waits for its dependencies, for the exit for the tasks depending on it
+    vector<vector<size_t>> vNext(nCount);
+    vector<size_t> vPending(nCount, 0);
+    vector<bool> vActive(nCount, true);
+    size_t nOpen{0};
+    for (size_t n = 0; n < nCount; ++n)
+    {
+        vActive[n] = bExit == false || m_vState[n].bInitDone == true;
+        if (vActive[n] == true)
+            ++nOpen;
+    }
+    for (size_t n = 0; n < nCount; ++n)
+    {
+        for (const size_t nDepend : m_vDepends[n])
+        {
+            if (vActive[n] == false || vActive[nDepend] == false)
+                continue;
+            const size_t nFirst = bExit == false ? nDepend : n;
+            const size_t nSecond = bExit == false ? n : nDepend;
+            vNext[nFirst].push_back(nSecond);
+            ++vPending[nSecond];
+        }
+    }
+
+    mutex mxGraph;
+    condition_variable cvGraph;
+    deque<size_t> dqReady;
+    size_t nRunning{0};
+    bool bFailed{false};
+    for (size_t n = 0; n < nCount; ++n)
+    {
+        if (vActive[n] == true && vPending[n] == 0)
+            dqReady.push_back(n);
+    }
+
+    auto fnWorker = [&]()
+    {
+        unique_lock<mutex> lock(mxGraph);
+        for (;;)
+        {
+            cvGraph.wait(lock, [&]() { return dqReady.empty() == false || nRunning == 0; });
+            if (dqReady.empty() == true)
+            {   // all done, or the rest of the graph can never start
+                cvGraph.notify_all();
+                return;
+            }
+
+            const size_t nTask = dqReady.front();
+            dqReady.pop_front();
+            ++nRunning;
+            lock.unlock();
+
+            const SrvTask& Task = m_vTasks[nTask];
+            const function<void()>& fnTask = bExit == false ? Task.fnInit : Task.fnExit;
+            string strError;
+            const auto tTask = chrono::steady_clock::now();
+            try
+            {
+                CTraceSpan Span(m_vState[nTask].szTraceName);
+                CSrvArenaScope ArenaScope;
+                if (fnTask != nullptr)
+                    fnTask();
+            }
+            catch (const exception& ex)
+            {
+                strError = "task " + Task.strName + " failed: " + ex.what() + "\n";
+            }
+            catch (...)
+            {
+                strError = "task " + Task.strName + " failed\n";
+            }
+            const auto tDuration = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - tTask);
+
+            lock.lock();
+            --nRunning;
+            --nOpen;
+            {
+                lock_guard<mutex> lockStats(m_mxStats);
+                (bExit == false ? m_vState[nTask].tInit : m_vState[nTask].tExit) = tDuration;
+                if (bExit == false)
+                    m_vState[nTask].bInitDone = strError.empty();
+                else
+                    m_vState[nTask].bInitDone = false;
+            }
+            m_strError += strError;
+
+            // after a failed init no more tasks are started, the exit runs all of them
+            if (strError.empty() == false && bExit == false)
+            {
+                bFailed = true;
+                dqReady.clear();
+            }
+            else if (bFailed == false)
+            {
+                for (const size_t nNext : vNext[nTask])
+                {
+                    if (--vPending[nNext] == 0)
+                        dqReady.push_back(nNext);
+                }
+            }
+            cvGraph.notify_all();
+        }
+    };
+
+    if (nThreads == 0)
+        nThreads = max(1u, thread::hardware_concurrency());
+    nThreads = static_cast<uint32_t>(min<size_t>(nThreads, max<size_t>(nOpen, 1)));
+    vector<thread> vThreads;
+    for (uint32_t n = 1; n < nThreads; ++n)
+        vThreads.emplace_back(fnWorker);
+    fnWorker();
+    for (auto& th : vThreads)
+        th.join();
+
+    if (bFailed == false && nOpen > 0)
+    {
+        m_strError += "the tasks have a cyclic dependency:";
+        for (size_t n = 0; n < nCount; ++n)
+        {
+            if (vActive[n] == true && vPending[n] > 0)
+                m_strError += " " + m_vTasks[n].strName;
+        }
+        m_strError += "\n";
+        bFailed = true;
+    }
+
+    lock_guard<mutex> lockStats(m_mxStats);
+    (bExit == false ? m_tInit : m_tExit) = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - tStart);
+    return bFailed == false;
+}
+
+void CSrvTaskGraph::GetStats(StatsList& lstStats)
+{
+    lock_guard<mutex> lock(m_mxStats);
+    lstStats.emplace_back("init_us", to_string(m_tInit.count()));
+    lstStats.emplace_back("exit_us", to_string(m_tExit.count()));
+    for (size_t n = 0; n < m_vTasks.size(); ++n)
+    {
+        lstStats.emplace_back(m_vTasks[n].strName + ".init_us", to_string(m_vState[n].tInit.count()));
+        lstStats.emplace_back(m_vTasks[n].strName + ".exit_us", to_string(m_vState[n].tExit.count()));
+    }
+}
@@ -0,0 +1,68 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVTASKGRAPH_H
+#define SRVTASKGRAPH_H
+
+#include "Service.h"
+#include "SrvStats.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Runs the init functions of the tasks in parallel, a task starts when all its dependencies are done.
+// The exit functions run in reverse order, a task exits when all tasks depending on it have exited.
+class CSrvTaskGraph
+{
+public:
+    explicit CSrvTaskGraph(const std::vector<SrvTask>& vTasks);
+    CSrvTaskGraph() = delete;
+    CSrvTaskGraph(const CSrvTaskGraph&) = delete;
+    CSrvTaskGraph(CSrvTaskGraph&&) = delete;
+    CSrvTaskGraph& operator=(const CSrvTaskGraph&) = delete;
+    CSrvTaskGraph& operator=(CSrvTaskGraph&&) = delete;
+
+    bool IsEmpty() const noexcept { return m_vTasks.empty(); }
+    // false if a task threw an exception or the graph has unknown dependencies or cycles
+    bool RunInit(uint32_t nThreads);
+    // only the tasks whose init function ran successfully
+    void RunExit(uint32_t nThreads);
+
+    const std::string& GetError() const noexcept { return m_strError; }
+    void GetStats(StatsList& lstStats);
+
+private:
+    struct TaskState
+    {
+        bool bInitDone{false};
+        const char* szTraceName{nullptr};       // the task name, see CSrvTrace::Intern
+        std::chrono::microseconds tInit{0};
+        std::chrono::microseconds tExit{0};
+    };
+
+    bool Run(bool bExit, uint32_t nThreads);
+
+private:
+    std::vector<SrvTask>             m_vTasks;
+    std::vector<std::vector<size_t>> m_vDepends;      // index of the tasks this task depends on
+    std::vector<TaskState>           m_vState;
+    std::chrono::microseconds        m_tInit{0};
+    std::chrono::microseconds        m_tExit{0};
+    std::mutex                       m_mxStats;
+    std::string                      m_strGraphError; // unknown dependencies
+    std::string                      m_strError;
+};
+
+#endif // SRVTASKGRAPH_H
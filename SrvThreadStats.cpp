@@ -0,0 +1,199 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvThreadStats.h"
+#include "SrvTrace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+namespace
+{
+    mutex& GetNamesMutex()
+    {
+        static mutex mxNames;
+        return mxNames;
+    }
+
+    map<pid_t, string>& GetNames()
+    {
+        static map<pid_t, string> mapNames;
+        return mapNames;
+    }
+
+    pid_t GetTid() noexcept
+    {
+        return static_cast<pid_t>(syscall(SYS_gettid));
+    }
+
+    uint64_t Delta(uint64_t nNow, uint64_t nLast) noexcept
+    {
+        return nNow > nLast ? nNow - nLast : 0;
+    }
+}
+
+void CSrvThreadStats::RegisterThread(const char* szName)
+{
+    CSrvTrace::SetThreadName(szName);
+    pthread_setname_np(pthread_self(), string(szName).substr(0, 15).c_str());
+    lock_guard<mutex> lock(GetNamesMutex());
+    GetNames()[GetTid()] = szName;
+}
+
+void CSrvThreadStats::UnregisterThread()
+{
+    lock_guard<mutex> lock(GetNamesMutex());
+    GetNames().erase(GetTid());
+}
+
+bool CSrvThreadStats::ReadThread(pid_t nTid, ThreadSample& Sample)
+{
+    const string strTask = "/proc/self/task/" + to_string(nTid);
+
+    ifstream finSched(strTask + "/schedstat");
+    if (!(finSched >> Sample.nCpuNs >> Sample.nWaitNs))
+    {
+        // without schedstat (CONFIG_SCHED_INFO) utime and stime are the fields 14 and 15 of stat, after the comm in ()
+        ifstream finStat(strTask + "/stat");
+        string strStat;
+        getline(finStat, strStat);
+        const size_t nPos = strStat.rfind(')');
+        if (nPos == string::npos || nPos + 2 >= strStat.size())
+            return false;
+        istringstream issStat(strStat.substr(nPos + 2));
+        string strField;
+        for (int n = 3; n <= 13 && issStat >> strField; ++n);
+        uint64_t nUserTicks{0}, nSysTicks{0};
+        if (!(issStat >> nUserTicks >> nSysTicks))
+            return false;
+        Sample.nCpuNs = (nUserTicks + nSysTicks) * 1000000000ull / static_cast<uint64_t>(sysconf(_SC_CLK_TCK));
+        Sample.nWaitNs = 0;
+    }
+
+    ifstream finStatus(strTask + "/status");
+    string strLine;
+    while (getline(finStatus, strLine))
+    {
+        if (strLine.compare(0, 24, "voluntary_ctxt_switches:") == 0)
+            Sample.nVoluntary = strtoull(strLine.c_str() + 24, nullptr, 10);
+        else if (strLine.compare(0, 27, "nonvoluntary_ctxt_switches:") == 0)
+            Sample.nInvoluntary = strtoull(strLine.c_str() + 27, nullptr, 10);
+    }
+    return true;
+}
+
+void CSrvThreadStats::Sample()
+{
+    const auto tNow = chrono::steady_clock::now();
+
+    map<pid_t, ThreadSample> mapCurrent;
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == nullptr)
+        return;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != nullptr)
+    {
+        char* endptr;
+        const long nTid = strtol(ent->d_name, &endptr, 10);
+        ThreadSample Sample;
+        if (*endptr == '\0' && nTid > 0 && ReadThread(static_cast<pid_t>(nTid), Sample) == true)
+            mapCurrent.emplace(static_cast<pid_t>(nTid), Sample);
+    }
+    closedir(dir);
+
+    map<pid_t, string> mapNames;
+    {
+        lock_guard<mutex> lock(GetNamesMutex());
+        // forget the threads which ended without UnregisterThread
+        for (auto itName = GetNames().begin(); itName != GetNames().end();)
+            itName = mapCurrent.find(itName->first) == mapCurrent.end() ? GetNames().erase(itName) : next(itName);
+        mapNames = GetNames();
+    }
+
+    int64_t nRssPages{0};
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp != nullptr)
+    {
+        long long nSize{0}, nResident{0};
+        if (fscanf(fp, "%lld %lld", &nSize, &nResident) == 2)
+            nRssPages = nResident;
+        fclose(fp);
+    }
+    const int64_t nRssKb = nRssPages * sysconf(_SC_PAGESIZE) / 1024;
+
+    lock_guard<mutex> lock(m_mxSample);
+    const bool bFirst = m_tLast == chrono::steady_clock::time_point();
+    const double dInterval = chrono::duration<double>(tNow - m_tLast).count();
+    map<string, ThreadTotal> mapTotals;
+    for (const auto& itThread : mapCurrent)
+    {
+        auto itName = mapNames.find(itThread.first);
+        ThreadTotal& Total = mapTotals[itName != mapNames.end() ? itName->second : "other"];
+        ++Total.nThreads;
+
+        auto itLast = m_mapLast.find(itThread.first);
+        if (bFirst == true || itLast == m_mapLast.end() || dInterval <= 0)
+            continue;
+        const ThreadSample& Now = itThread.second;
+        const ThreadSample& Last = itLast->second;
+        Total.dCpuPercent += static_cast<double>(Delta(Now.nCpuNs, Last.nCpuNs)) / 1e9 / dInterval * 100.0;
+        Total.nWaitUs += Delta(Now.nWaitNs, Last.nWaitNs) / 1000;
+        Total.nVoluntary += Delta(Now.nVoluntary, Last.nVoluntary);
+        Total.nInvoluntary += Delta(Now.nInvoluntary, Last.nInvoluntary);
+    }
+
+    m_nRssDeltaKb = bFirst == true ? 0 : nRssKb - m_nRssKb;
+    m_nRssKb = nRssKb;
+    m_mapLast.swap(mapCurrent);
+    m_mapTotals.swap(mapTotals);
+    m_tLast = tNow;
+}
+
+void CSrvThreadStats::GetStats(StatsList& lstStats)
+{
+    {
+        lock_guard<mutex> lock(m_mxSample);
+        for (const auto& itTotal : m_mapTotals)
+        {
+            char szCpu[32];
+            snprintf(szCpu, sizeof(szCpu), "%.1f", itTotal.second.dCpuPercent);
+            lstStats.emplace_back(itTotal.first + ".threads", to_string(itTotal.second.nThreads));
+            lstStats.emplace_back(itTotal.first + ".cpu_pct", szCpu);
+            lstStats.emplace_back(itTotal.first + ".runq_delay_us", to_string(itTotal.second.nWaitUs));
+            lstStats.emplace_back(itTotal.first + ".voluntary_switches", to_string(itTotal.second.nVoluntary));
+            lstStats.emplace_back(itTotal.first + ".involuntary_switches", to_string(itTotal.second.nInvoluntary));
+        }
+        lstStats.emplace_back("process.rss_kb", to_string(m_nRssKb));
+        lstStats.emplace_back("process.rss_delta_kb", to_string(m_nRssDeltaKb));
+    }
+
+    rusage ru{};
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+    {
+        lstStats.emplace_back("process.maxrss_kb", to_string(ru.ru_maxrss));
+        lstStats.emplace_back("process.minflt", to_string(ru.ru_minflt));
+        lstStats.emplace_back("process.majflt", to_string(ru.ru_majflt));
+        lstStats.emplace_back("process.voluntary_switches", to_string(ru.ru_nvcsw));
+        lstStats.emplace_back("process.involuntary_switches", to_string(ru.ru_nivcsw));
+    }
+}
+#endif
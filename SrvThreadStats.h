@@ -0,0 +1,75 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVTHREADSTATS_H
+#define SRVTHREADSTATS_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvStats.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+
+// Per thread accounting from /proc/self/task/*/stat, status and schedstat. The values of the threads registered with
+// the same name are added up, all other threads are reported as "other". Sample is called periodically
+// by the event loop, GetStats returns the values of the last interval.
+class CSrvThreadStats
+{
+public:
+    CSrvThreadStats() = default;
+    CSrvThreadStats(const CSrvThreadStats&) = delete;
+    CSrvThreadStats(CSrvThreadStats&&) = delete;
+    CSrvThreadStats& operator=(const CSrvThreadStats&) = delete;
+    CSrvThreadStats& operator=(CSrvThreadStats&&) = delete;
+
+    // names the calling thread, also for the trace and in /proc (comm), szName must be a string literal
+    static void RegisterThread(const char* szName);
+    static void UnregisterThread();
+
+    void Sample();
+    void GetStats(StatsList& lstStats);
+
+private:
+    struct ThreadSample
+    {
+        uint64_t nCpuNs{0};             // on cpu, from schedstat or utime + stime
+        uint64_t nWaitNs{0};            // runnable but waiting for a cpu (run queue delay)
+        uint64_t nVoluntary{0};
+        uint64_t nInvoluntary{0};
+    };
+
+    struct ThreadTotal
+    {
+        double   dCpuPercent{0};
+        uint64_t nWaitUs{0};
+        uint64_t nVoluntary{0};
+        uint64_t nInvoluntary{0};
+        uint32_t nThreads{0};
+    };
+
+    static bool ReadThread(pid_t nTid, ThreadSample& Sample);
+
+private:
+    std::mutex                            m_mxSample;
+    std::map<pid_t, ThreadSample>         m_mapLast;
+    std::map<std::string, ThreadTotal>    m_mapTotals;
+    std::chrono::steady_clock::time_point m_tLast;
+    int64_t                               m_nRssKb{0};
+    int64_t                               m_nRssDeltaKb{0};
+};
+#endif
+
+#endif // SRVTHREADSTATS_H
@@ -0,0 +1,262 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#include "SrvTrace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    constexpr uint64_t TRACE_RINGSIZE = 8192;     // Events per thread, must be a power of 2
+    constexpr uint64_t TRACE_INSTANT  = ~0ull;    // Duration marker for instant events
+
+    struct TraceEvent
+    {
+        atomic<uint64_t>    nSeq{0};              // index + 1 of the event, 0 while it is written
+        atomic<const char*> szName{nullptr};
+        atomic<uint64_t>    nStart{0};
+        atomic<uint64_t>    nDuration{0};
+    };
+
+    struct TraceBuffer
+    {
+        atomic<uint64_t>    nHead{0};
+        atomic<const char*> szThreadName{nullptr};
+        uint64_t            nTid{0};
+        bool                bInUse{true};         // guarded by TraceRegistry::mxBuffers
+        TraceEvent          aEvents[TRACE_RINGSIZE];
+    };
+
+    struct TraceRegistry
+    {
+        mutex mxBuffers;
+        vector<unique_ptr<TraceBuffer>> vBuffers;
+        set<string> setNames;   // the interned names, guarded by mxBuffers
+    };
+
+    TraceRegistry& GetRegistry()
+    {
+        static TraceRegistry* pRegistry = new TraceRegistry();  // never destroyed, threads may still trace on exit
+        return *pRegistry;
+    }
+
+    uint64_t GetThreadId() noexcept
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        return GetCurrentThreadId();
+#else
+        return static_cast<uint64_t>(syscall(SYS_gettid));
+#endif
+    }
+
+    uint64_t GetProcessId() noexcept
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        return GetCurrentProcessId();
+#else
+        return static_cast<uint64_t>(getpid());
+#endif
+    }
+
+    // Gives the buffer free for the next new thread, when the thread ends
+    struct ThreadSlot
+    {
+        TraceBuffer* pBuffer{nullptr};
+        const char*  szThreadName{nullptr};   // kept here until the thread records its first event
+        bool         bEnded{false};           // a later thread_local destructor records nothing
+        ~ThreadSlot()
+        {
+            if (pBuffer != nullptr)
+            {
+                lock_guard<mutex> lock(GetRegistry().mxBuffers);
+                pBuffer->bInUse = false;
+            }
+            // the buffer may already be reused by another thread
+            pBuffer = nullptr;
+            bEnded = true;
+        }
+    };
+    thread_local ThreadSlot s_ThreadSlot;
+
+    TraceBuffer* GetThreadBuffer() noexcept
+    {
+        if (s_ThreadSlot.pBuffer != nullptr || s_ThreadSlot.bEnded == true)
+            return s_ThreadSlot.pBuffer;
+
+        try
+        {
+            TraceRegistry& Registry = GetRegistry();
+            lock_guard<mutex> lock(Registry.mxBuffers);
+            for (auto& pBuffer : Registry.vBuffers)
+            {
+                if (pBuffer->bInUse == false)   // Buffer of a terminated thread, the old events get lost
+                {
+                    pBuffer->bInUse = true;
+                    pBuffer->nTid = GetThreadId();
+                    pBuffer->szThreadName.store(s_ThreadSlot.szThreadName, memory_order_relaxed);
+                    pBuffer->nHead.store(0, memory_order_relaxed);
+                    for (auto& ev : pBuffer->aEvents)
+                        ev.nSeq.store(0, memory_order_relaxed);
+                    s_ThreadSlot.pBuffer = pBuffer.get();
+                    return s_ThreadSlot.pBuffer;
+                }
+            }
+            Registry.vBuffers.emplace_back(make_unique<TraceBuffer>());
+            Registry.vBuffers.back()->nTid = GetThreadId();
+            Registry.vBuffers.back()->szThreadName.store(s_ThreadSlot.szThreadName, memory_order_relaxed);
+            s_ThreadSlot.pBuffer = Registry.vBuffers.back().get();
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+        return s_ThreadSlot.pBuffer;
+    }
+
+    void Record(const char* szName, uint64_t nStart, uint64_t nDuration) noexcept
+    {
+        // a thread gets its buffer with the first event, not if tracing is off
+        if (s_ThreadSlot.pBuffer == nullptr && CSrvTrace::IsEnabled() == false)
+            return;
+        TraceBuffer* pBuffer = GetThreadBuffer();
+        if (pBuffer == nullptr)
+            return;
+
+        // only this thread writes into the buffer, the dump reads the slot like a seqlock
+        const uint64_t nIndex = pBuffer->nHead.load(memory_order_relaxed);
+        TraceEvent& ev = pBuffer->aEvents[nIndex & (TRACE_RINGSIZE - 1)];
+        ev.nSeq.store(0, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        ev.szName.store(szName, memory_order_relaxed);
+        ev.nStart.store(nStart, memory_order_relaxed);
+        ev.nDuration.store(nDuration, memory_order_relaxed);
+        ev.nSeq.store(nIndex + 1, memory_order_release);
+        pBuffer->nHead.store(nIndex + 1, memory_order_release);
+    }
+
+    void WriteJsonString(FILE* fp, const char* szText)
+    {
+        fputc('"', fp);
+        for (const char* p = szText != nullptr ? szText : "?"; *p != 0; ++p)
+        {
+            if (*p == '"' || *p == '\\')
+                fputc('\\', fp);
+            if (static_cast<unsigned char>(*p) >= 0x20)
+                fputc(*p, fp);
+        }
+        fputc('"', fp);
+    }
+}
+
+atomic<bool> CSrvTrace::s_bEnabled{false};
+
+uint64_t CSrvTrace::Now() noexcept
+{
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void CSrvTrace::Span(const char* szName, uint64_t nStart, uint64_t nEnd) noexcept
+{
+    Record(szName, nStart, nEnd - nStart);
+}
+
+void CSrvTrace::Instant(const char* szName) noexcept
+{
+    Record(szName, Now(), TRACE_INSTANT);
+}
+
+void CSrvTrace::SetThreadName(const char* szName) noexcept
+{
+    s_ThreadSlot.szThreadName = szName;
+    if (s_ThreadSlot.pBuffer != nullptr)
+        s_ThreadSlot.pBuffer->szThreadName.store(szName, memory_order_relaxed);
+}
+
+const char* CSrvTrace::Intern(const string& strName)
+{
+    TraceRegistry& Registry = GetRegistry();
+    lock_guard<mutex> lock(Registry.mxBuffers);
+    return Registry.setNames.insert(strName).first->c_str();
+}
+
+bool CSrvTrace::Dump(const string& strFileName)
+{
+    const string strTmpFile = strFileName + ".tmp";
+    FILE* fp = fopen(strTmpFile.c_str(), "w");
+    if (fp == nullptr)
+        return false;
+
+    const unsigned long long nPid = GetProcessId();
+    bool bFirst = true;
+    auto fnSeparator = [&]() { fputs(bFirst == true ? "\n" : ",\n", fp); bFirst = false; };
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", fp);
+
+    TraceRegistry& Registry = GetRegistry();
+    lock_guard<mutex> lock(Registry.mxBuffers);
+    for (auto& pBuffer : Registry.vBuffers)
+    {
+        const unsigned long long nTid = pBuffer->nTid;
+        const char* szThreadName = pBuffer->szThreadName.load(memory_order_relaxed);
+        if (szThreadName != nullptr)
+        {
+            fnSeparator();
+            fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%llu,\"tid\":%llu,\"args\":{\"name\":", nPid, nTid);
+            WriteJsonString(fp, szThreadName);
+            fputs("}}", fp);
+        }
+
+        const uint64_t nHead = pBuffer->nHead.load(memory_order_acquire);
+        for (uint64_t nIndex = nHead > TRACE_RINGSIZE ? nHead - TRACE_RINGSIZE : 0; nIndex < nHead; ++nIndex)
+        {
+            TraceEvent& ev = pBuffer->aEvents[nIndex & (TRACE_RINGSIZE - 1)];
+            const uint64_t nSeq = ev.nSeq.load(memory_order_acquire);
+            const char* szName = ev.szName.load(memory_order_relaxed);
+            const uint64_t nStart = ev.nStart.load(memory_order_relaxed);
+            const uint64_t nDuration = ev.nDuration.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (nSeq != nIndex + 1 || ev.nSeq.load(memory_order_relaxed) != nSeq)
+                continue;   // overwritten while we read it
+
+            fnSeparator();
+            fputs("{\"name\":", fp);
+            WriteJsonString(fp, szName);
+            if (nDuration == TRACE_INSTANT)
+                fprintf(fp, ",\"cat\":\"srvlib\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%llu,\"tid\":%llu}", nStart / 1000.0, nPid, nTid);
+            else
+                fprintf(fp, ",\"cat\":\"srvlib\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%llu,\"tid\":%llu}", nStart / 1000.0, nDuration / 1000.0, nPid, nTid);
+        }
+    }
+
+    fputs("\n]}\n", fp);
+    const bool bOk = ferror(fp) == 0;
+    if (fclose(fp) != 0 || bOk == false)
+    {
+        remove(strTmpFile.c_str());
+        return false;
+    }
+    return rename(strTmpFile.c_str(), strFileName.c_str()) == 0;
+}
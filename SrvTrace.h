@@ -0,0 +1,63 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVTRACE_H
+#define SRVTRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// In process event tracing. Every thread records into its own ring buffer,
+// the buffers are written on demand in the Chrome trace-event format (Perfetto, chrome://tracing)
+// All names must be string literals (or live as long as the process), only the pointer is stored
+class CSrvTrace
+{
+public:
+    static void Enable(bool bEnable) noexcept { s_bEnabled.store(bEnable, std::memory_order_relaxed); }
+    static bool IsEnabled() noexcept { return s_bEnabled.load(std::memory_order_relaxed); }
+
+    static uint64_t Now() noexcept;
+    static void Span(const char* szName, uint64_t nStart, uint64_t nEnd) noexcept;
+    static void Instant(const char* szName) noexcept;
+    static void SetThreadName(const char* szName) noexcept;
+    // a copy of a name known only at run time, it is never freed, equal names share one copy
+    static const char* Intern(const std::string& strName);
+
+    static bool Dump(const std::string& strFileName);
+
+private:
+    static std::atomic<bool> s_bEnabled;
+};
+
+class CTraceSpan
+{
+public:
+    explicit CTraceSpan(const char* szName) noexcept : m_szName(szName), m_nStart(CSrvTrace::IsEnabled() == true ? CSrvTrace::Now() : 0) {}
+    ~CTraceSpan() { if (m_nStart != 0) CSrvTrace::Span(m_szName, m_nStart, CSrvTrace::Now()); }
+    CTraceSpan() = delete;
+    CTraceSpan(const CTraceSpan&) = delete;
+    CTraceSpan(CTraceSpan&&) = delete;
+    CTraceSpan& operator=(const CTraceSpan&) = delete;
+    CTraceSpan& operator=(CTraceSpan&&) = delete;
+
+private:
+    const char* m_szName;
+    uint64_t    m_nStart;
+};
+
+#define SRVTRACE_CONCAT2(a, b) a##b
+#define SRVTRACE_CONCAT(a, b) SRVTRACE_CONCAT2(a, b)
+#define SRVTRACE_SCOPE(name) CTraceSpan SRVTRACE_CONCAT(_traceSpan, __LINE__)(name)
+#define SRVTRACE_INSTANT(name) do { if (CSrvTrace::IsEnabled() == true) CSrvTrace::Instant(name); } while (0)
+
+#endif // SRVTRACE_H
@@ -0,0 +1,281 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvWatchdog.h"
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cxxabi.h>
+#include <execinfo.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+using namespace std;
+
+namespace
+{
+    constexpr int MAX_THREADS = 64;
+    constexpr int MAX_DEPTH = 48;
+    constexpr int SKIP_FRAMES = 2;      // the signal handler and the signal trampoline
+
+    struct WatchSlot
+    {
+        atomic<pid_t>   nTid{0};
+        const char*     szName{nullptr};
+        atomic<int64_t> nBusySince{0};  // steady clock in ns, 0 = idle
+        int64_t         nReported{0};   // nBusySince of the last report, only used by the monitor
+        atomic<int>     nDepth{-1};     // -1 = no backtrace yet
+        void*           aFrames[MAX_DEPTH];
+    };
+
+    struct WatchState
+    {
+        mutex                   mxControl;
+        condition_variable      cvControl;
+        atomic<bool>            bActive{false};
+        bool                    bStop{false};
+        thread                  thMonitor;
+        chrono::milliseconds    tThreshold{0};
+        function<void(const string&)> fnReport;
+        atomic<uint64_t>        nStalls{0};
+        atomic<int64_t>         nMaxStallMs{0};
+        WatchSlot               aSlots[MAX_THREADS];
+    };
+    WatchState s_State;
+    thread_local WatchSlot* t_pSlot = nullptr;
+
+    int64_t GetNow() noexcept
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void WatchHandler(int, siginfo_t*, void*)
+    {
+        const int iErrno = errno;
+        const pid_t nTid = static_cast<pid_t>(syscall(SYS_gettid));
+        for (WatchSlot& Slot : s_State.aSlots)
+        {
+            if (Slot.nTid.load() == nTid)
+            {
+                Slot.nDepth.store(backtrace(Slot.aFrames, MAX_DEPTH));
+                break;
+            }
+        }
+        errno = iErrno;
+    }
+
+    // "module(mangled+0x12) [0x...]" -> "demangled"
+    string GetFrameName(const string& strSymbol)
+    {
+        const size_t nOpen = strSymbol.find('(');
+        const size_t nPlus = strSymbol.find('+', nOpen);
+        const size_t nClose = strSymbol.find(')', nOpen);
+        if (nOpen == string::npos || nPlus == string::npos || nClose == string::npos || nPlus > nClose || nPlus == nOpen + 1)
+            return strSymbol;
+
+        const string strMangled = strSymbol.substr(nOpen + 1, nPlus - nOpen - 1);
+        int iStatus{0};
+        char* szDemangled = abi::__cxa_demangle(strMangled.c_str(), nullptr, nullptr, &iStatus);
+        const string strName = iStatus == 0 && szDemangled != nullptr ? szDemangled : strMangled;
+        free(szDemangled);
+        return strName + " (" + strSymbol.substr(0, nOpen) + ")";
+    }
+
+    string GetBacktrace(WatchSlot& Slot)
+    {
+        const int iDepth = Slot.nDepth.load();
+        if (iDepth <= SKIP_FRAMES)
+            return "  no backtrace\n";
+
+        string strTrace;
+        char** pSymbols = backtrace_symbols(Slot.aFrames + SKIP_FRAMES, iDepth - SKIP_FRAMES);
+        for (int n = 0; pSymbols != nullptr && n < iDepth - SKIP_FRAMES; ++n)
+            strTrace += "  " + GetFrameName(pSymbols[n]) + "\n";
+        free(pSymbols);
+        return strTrace;
+    }
+
+    struct Stall
+    {
+        WatchSlot*  pSlot;
+        pid_t       nTid;
+        const char* szName;
+        int64_t     nSince;
+    };
+
+    void Monitor()
+    {
+        const chrono::milliseconds tInterval = max(s_State.tThreshold / 4, chrono::milliseconds(10));
+        const int64_t nThreshold = chrono::duration_cast<chrono::nanoseconds>(s_State.tThreshold).count();
+        const pid_t nPid = getpid();
+        vector<string> vEnded;
+        vector<Stall> vStalls;
+
+        unique_lock<mutex> lock(s_State.mxControl);
+        while (s_State.cvControl.wait_for(lock, tInterval, []() { return s_State.bStop; }) == false)
+        {
+            // only the slots are read with the lock, the event loops register their threads while we report
+            vEnded.clear();
+            vStalls.clear();
+            for (WatchSlot& Slot : s_State.aSlots)
+            {
+                const pid_t nTid = Slot.nTid.load();
+                const int64_t nSince = Slot.nBusySince.load();
+                if (nTid == 0)
+                    continue;
+
+                // a reported stall ended, now we know how long it was
+                if (Slot.nReported != 0 && Slot.nReported != nSince)
+                {   // it ended before the next work began, or before now
+                    const int64_t nStallMs = ((nSince != 0 ? nSince : GetNow()) - Slot.nReported) / 1000000;
+                    Slot.nReported = 0;
+                    if (nStallMs > s_State.nMaxStallMs.load())
+                        s_State.nMaxStallMs.store(nStallMs);
+                    vEnded.push_back(string("thread ") + Slot.szName + " was blocked for " + to_string(nStallMs) + " ms");
+                }
+                if (nSince == 0 || nSince == Slot.nReported || GetNow() - nSince < nThreshold)
+                    continue;
+
+                Slot.nReported = nSince;
+                Slot.nDepth.store(-1);
+                vStalls.push_back({ &Slot, nTid, Slot.szName, nSince });
+            }
+            lock.unlock();
+
+            for (const string& strReport : vEnded)
+                s_State.fnReport(strReport);
+            for (const Stall& Info : vStalls)
+            {
+                if (syscall(SYS_tgkill, nPid, Info.nTid, CSrvWatchdog::GetSignal()) != 0)
+                    continue;
+                // the handler runs when the thread is scheduled, a thread in a system call is interrupted.
+                // A thread unregistered in the meantime finds no slot, then there is no backtrace.
+                for (int n = 0; n < 100 && Info.pSlot->nDepth.load() < 0; ++n)
+                    this_thread::sleep_for(chrono::milliseconds(1));
+
+                const int64_t nStallMs = (GetNow() - Info.nSince) / 1000000;
+                ++s_State.nStalls;
+                if (nStallMs > s_State.nMaxStallMs.load())
+                    s_State.nMaxStallMs.store(nStallMs);
+                s_State.fnReport(string("thread ") + Info.szName + " is blocked for " + to_string(nStallMs) + " ms in:\n" + GetBacktrace(*Info.pSlot));
+            }
+            lock.lock();
+        }
+    }
+}
+
+int CSrvWatchdog::GetSignal() noexcept
+{
+    return SIGRTMIN + 3;
+}
+
+bool CSrvWatchdog::Start(chrono::milliseconds tThreshold, function<void(const string&)> fnReport)
+{
+    lock_guard<mutex> lock(s_State.mxControl);
+    if (s_State.bActive == true || tThreshold.count() <= 0 || fnReport == nullptr)
+        return false;
+
+    // the first backtrace loads the unwinder, that must not happen in the signal handler
+    void* aPrime[4];
+    backtrace(aPrime, 4);
+
+    struct sigaction sa{};
+    sa.sa_sigaction = WatchHandler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(GetSignal(), &sa, nullptr) != 0)
+        return false;
+
+    s_State.tThreshold = tThreshold;
+    s_State.fnReport = fnReport;
+    s_State.bStop = false;
+    for (WatchSlot& Slot : s_State.aSlots)
+        Slot.nReported = 0;
+    s_State.thMonitor = thread(Monitor);
+    s_State.bActive = true;
+    return true;
+}
+
+void CSrvWatchdog::Stop()
+{
+    {
+        lock_guard<mutex> lock(s_State.mxControl);
+        if (s_State.bActive == false)
+            return;
+        s_State.bStop = true;
+        s_State.bActive = false;
+    }
+    s_State.cvControl.notify_all();
+    s_State.thMonitor.join();
+}
+
+bool CSrvWatchdog::IsActive() noexcept
+{
+    return s_State.bActive.load();
+}
+
+bool CSrvWatchdog::RegisterThread(const char* szName)
+{
+    if (t_pSlot != nullptr)
+        return true;
+
+    lock_guard<mutex> lock(s_State.mxControl);
+    for (WatchSlot& Slot : s_State.aSlots)
+    {
+        if (Slot.nTid.load() == 0)
+        {
+            Slot.szName = szName;
+            Slot.nBusySince.store(0);
+            Slot.nReported = 0;
+            Slot.nTid.store(static_cast<pid_t>(syscall(SYS_gettid)));
+            t_pSlot = &Slot;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CSrvWatchdog::UnregisterThread()
+{
+    if (t_pSlot == nullptr)
+        return;
+
+    lock_guard<mutex> lock(s_State.mxControl);
+    t_pSlot->nTid.store(0);
+    t_pSlot = nullptr;
+}
+
+void CSrvWatchdog::BeginWork() noexcept
+{
+    if (t_pSlot != nullptr)
+        t_pSlot->nBusySince.store(GetNow(), memory_order_relaxed);
+}
+
+void CSrvWatchdog::EndWork() noexcept
+{
+    if (t_pSlot != nullptr)
+        t_pSlot->nBusySince.store(0, memory_order_relaxed);
+}
+
+void CSrvWatchdog::GetStats(StatsList& lstStats)
+{
+    lstStats.emplace_back("stalls", to_string(s_State.nStalls.load()));
+    lstStats.emplace_back("max_stall_ms", to_string(s_State.nMaxStallMs.load()));
+}
+#endif
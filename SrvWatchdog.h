@@ -0,0 +1,47 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVWATCHDOG_H
+#define SRVWATCHDOG_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvStats.h"
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+// Finds callbacks that block their thread. A registered thread marks the begin and the end of each piece of work
+// (the event loop does this for every callback), a monitor thread checks the marks. If one is older than the threshold,
+// the thread gets GetSignal() and its handler takes the backtrace, which is reported with the duration of the stall.
+class CSrvWatchdog
+{
+public:
+    // the signal that takes the backtrace of the stalled thread (SIGRTMIN + 3)
+    static int  GetSignal() noexcept;
+
+    static bool Start(std::chrono::milliseconds tThreshold, std::function<void(const std::string&)> fnReport);
+    static void Stop();
+    static bool IsActive() noexcept;
+
+    // szName must be a string literal, up to 64 threads
+    static bool RegisterThread(const char* szName);
+    static void UnregisterThread();
+    // cheap, only a clock read and an atomic store, nothing happens in threads not registered
+    static void BeginWork() noexcept;
+    static void EndWork() noexcept;
+
+    static void GetStats(StatsList& lstStats);
+};
+#endif
+
+#endif // SRVWATCHDOG_H
@@ -0,0 +1,516 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "SrvWorkers.h"
+#include "SrvFleet.h"
+#include "SrvHeap.h"
+#include "SrvProfiler.h"
+#include "SrvSharedConfig.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+namespace
+{
+    CSrvWorkers* s_pInstance = nullptr;
+
+    uint64_t GetRssKb(pid_t nPid)
+    {
+        ifstream fin("/proc/" + to_string(nPid) + "/statm");
+        uint64_t nSize{0}, nResident{0};
+        if (!(fin >> nSize >> nResident))
+            return 0;
+        return nResident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) / 1024;
+    }
+
+    uint32_t GetFdCount(pid_t nPid)
+    {
+        DIR* dir = opendir(string("/proc/" + to_string(nPid) + "/fd").c_str());
+        if (dir == nullptr)
+            return 0;
+        uint32_t nCount{0};
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != nullptr)
+        {
+            if (ent->d_name[0] != '.')
+                ++nCount;
+        }
+        closedir(dir);
+        return nCount;
+    }
+}
+
+constexpr int CSrvWorkers::EXIT_IDLE;
+
+CSrvWorkers::CSrvWorkers(const SrvParam& SrvPara, function<int(uint32_t, int)> fnWorker) : m_SrvPara(SrvPara), m_fnWorker(fnWorker), m_FileWatch(m_EventLoop),
+    m_bStarted(false), m_bStopping(false), m_bDone(false), m_iExit(0), m_iStatsId(-1), m_fdConfig(-1), m_nGeneration(0), m_nRecycles(0), m_nRestarts(0), m_Random(random_device()())
+{
+}
+
+int CSrvWorkers::Run()
+{
+    if (m_SrvPara.nWorkers == 0 || s_pInstance != nullptr)
+        return EXIT_FAILURE;
+    if (m_SrvPara.fnSerializeConfig != nullptr && PublishConfig() == false)
+        return EXIT_FAILURE;
+    s_pInstance = this;
+
+    // the workers get the signal handlers of the program back
+    for (const int iSignal : { SIGHUP, SIGQUIT, SIGTERM, SIGINT, SIGUSR1, SIGUSR2, CSrvProfiler::GetSignal(), CSrvHeap::GetSignal() })
+    {
+        struct sigaction sa{}, saOld{};
+        sa.sa_handler = SignalHandler;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(iSignal, &sa, &saOld) == 0)
+            m_vOldActions.emplace_back(iSignal, saOld);
+
+        if (iSignal == SIGQUIT || iSignal == SIGTERM || iSignal == SIGINT)
+            m_EventLoop.OnSignal(iSignal, [this]() { StopWorkers(); });
+        else
+        {
+            m_EventLoop.OnSignal(iSignal, [this, iSignal]()
+            {
+                if (iSignal == SIGUSR2 && m_strStatsFile.empty() == false && CSrvStats::Dump(m_strStatsFile) == false)
+                    syslog(LOG_WARNING, "Statistics could not be written to %s", m_strStatsFile.c_str());
+                // with a shared configuration the workers reload when they get the new one
+                if (iSignal == SIGHUP && m_SrvPara.fnSerializeConfig != nullptr)
+                {
+                    PassOnConfig();
+                    return;
+                }
+                for (const Worker& W : m_vWorkers)
+                {
+                    if (W.bRetiring == false)
+                        kill(W.nPid, iSignal);
+                }
+            });
+        }
+    }
+    m_iStatsId = CSrvStats::AddProvider("workers", [this](StatsList& lstStats) { GetStats(lstStats); });
+
+    const int iTimer = m_EventLoop.AddTimer(chrono::seconds(1), [this]() { Check(); });
+    if (m_SrvPara.fnSerializeConfig != nullptr && m_SrvPara.vWatchFiles.empty() == false
+        && m_FileWatch.Start(m_SrvPara.vWatchFiles, chrono::milliseconds(m_SrvPara.nWatchDebounceMs), [this]() { PassOnConfig(); }) == false)
+        syslog(LOG_WARNING, "the configuration files cannot be watched");
+    m_EventLoop.Start();
+    m_EventLoop.Post([this]()
+    {
+        for (uint32_t n = 0; n < m_SrvPara.nWorkers; ++n)
+            Spawn(n, 0);
+    });
+
+    {
+        unique_lock<mutex> lock(m_mxWorkers);
+        m_cvDone.wait(lock, [&]() { return m_bDone; });
+    }
+
+    m_EventLoop.Stop();
+    m_EventLoop.RemoveTimer(iTimer);
+    m_FileWatch.Stop();
+    CSrvStats::RemoveProvider(m_iStatsId);
+    for (const auto& Action : m_vOldActions)
+        sigaction(Action.first, &Action.second, nullptr);
+    m_vOldActions.clear();
+    s_pInstance = nullptr;
+    if (m_fdConfig >= 0)
+        close(m_fdConfig);
+    m_fdConfig = -1;
+    return m_iExit;
+}
+
+bool CSrvWorkers::PublishConfig()
+{
+    string strData;
+    try
+    {
+        strData = m_SrvPara.fnSerializeConfig();
+    }
+    catch (const exception& ex)
+    {
+        syslog(LOG_ERR, "the configuration could not be read: %s", ex.what());
+        return false;
+    }
+
+    const int fdConfig = CSrvSharedConfig::Publish(strData);
+    if (fdConfig < 0)
+    {
+        syslog(LOG_ERR, "the configuration could not be shared");
+        return false;
+    }
+    if (m_fdConfig >= 0)
+        close(m_fdConfig);
+    m_fdConfig = fdConfig;
+    m_nGeneration = CSrvSharedConfig::Get()->GetGeneration();
+    syslog(LOG_NOTICE, "configuration %llu with %zu bytes", static_cast<unsigned long long>(m_nGeneration), strData.size());
+    return true;
+}
+
+void CSrvWorkers::PassOnConfig()
+{
+    if (PublishConfig() == false)
+        return;
+    for (const Worker& W : m_vWorkers)
+    {
+        if (W.bRetiring == false && CSrvSharedConfig::Send(W.fdConfig, m_fdConfig, m_nGeneration) == false)
+            syslog(LOG_WARNING, "worker %u did not get the configuration %llu", W.nIndex, static_cast<unsigned long long>(m_nGeneration));
+    }
+}
+
+void CSrvWorkers::Stop()
+{
+    m_EventLoop.Post([this]() { StopWorkers(); });
+}
+
+void CSrvWorkers::SignalHandler(int iSignal)
+{
+    if (s_pInstance != nullptr)
+        s_pInstance->m_EventLoop.PostSignal(iSignal);
+}
+
+void CSrvWorkers::Spawn(uint32_t nIndex, pid_t nReplaces)
+{
+    int fdPipe[2] = { -1, -1 };
+    if (pipe2(fdPipe, O_CLOEXEC) < 0)
+    {
+        syslog(LOG_ERR, "no pipe for worker %u", nIndex);
+        return;
+    }
+
+    int fdChannel[2] = { -1, -1 };
+    if (m_SrvPara.fnSerializeConfig != nullptr && socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fdChannel) < 0)
+        syslog(LOG_WARNING, "worker %u gets no new configurations", nIndex);
+
+    const pid_t nPid = fork();
+    if (nPid < 0)
+    {
+        syslog(LOG_ERR, "worker %u could not be started", nIndex);
+        for (const int fd : { fdPipe[0], fdPipe[1], fdChannel[0], fdChannel[1] })
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+        return;
+    }
+    if (nPid == 0)
+    {   // the worker, only this thread exists, the master state is left as it is
+        close(fdPipe[0]);
+        for (const Worker& W : m_vWorkers)
+        {
+            close(W.fdReady);
+            close(W.fdPid);
+            close(W.fdConfig);
+        }
+        if (m_SrvPara.fnSerializeConfig != nullptr)
+        {
+            if (fdChannel[0] >= 0)
+                close(fdChannel[0]);
+            CSrvSharedConfig::Init(fdChannel[1], m_fdConfig, m_nGeneration);
+            close(m_fdConfig);
+        }
+        // a program without its own SIGTERM handler drains on SIGTERM too, not only on the SIGQUIT of the master
+        const auto itQuit = find_if(m_vOldActions.begin(), m_vOldActions.end(), [](const pair<int, struct sigaction>& Action) { return Action.first == SIGQUIT; });
+        for (const auto& Action : m_vOldActions)
+        {
+            const bool bDefault = (Action.second.sa_flags & SA_SIGINFO) == 0 && Action.second.sa_handler == SIG_DFL;
+            if (Action.first == SIGTERM && bDefault == true && itQuit != m_vOldActions.end())
+                sigaction(SIGTERM, &itQuit->second, nullptr);
+            else
+                sigaction(Action.first, &Action.second, nullptr);
+        }
+        CSrvStats::RemoveProvider(m_iStatsId);
+        _exit(m_fnWorker(nIndex, fdPipe[1]));
+    }
+    close(fdPipe[1]);
+    if (fdChannel[1] >= 0)
+        close(fdChannel[1]);
+
+    Worker W;
+    W.nPid = nPid;
+    W.nIndex = nIndex;
+    W.fdReady = fdPipe[0];
+    W.fdPid = CSrvFleet::OpenPid(nPid);
+    W.fdConfig = fdChannel[0];
+    W.nReplaces = nReplaces;
+    W.tStart = chrono::steady_clock::now();
+    // every worker gets its own age limit, so workers started together are not replaced together
+    const uint32_t nJitterPct = min(m_SrvPara.nWorkerJitterPct, 100u);
+    const double dFactor = 1.0 - uniform_real_distribution<double>(0.0, nJitterPct / 100.0)(m_Random);
+    W.tMaxAge = W.tStart + chrono::milliseconds(static_cast<int64_t>(m_SrvPara.nWorkerMaxAgeS * 1000.0 * dFactor));
+
+    m_EventLoop.AddFd(W.fdReady, EPOLLIN, [this, nPid](uint32_t) { OnReady(nPid); });
+    if (W.fdPid >= 0)
+        m_EventLoop.AddFd(W.fdPid, EPOLLIN, [this, nPid](uint32_t) { Reap(nPid); });
+
+    lock_guard<mutex> lock(m_mxWorkers);
+    m_vWorkers.push_back(W);
+}
+
+CSrvWorkers::Worker* CSrvWorkers::Find(pid_t nPid)
+{
+    auto itWorker = find_if(m_vWorkers.begin(), m_vWorkers.end(), [nPid](const Worker& W) { return W.nPid == nPid; });
+    return itWorker != m_vWorkers.end() ? &*itWorker : nullptr;
+}
+
+void CSrvWorkers::OnReady(pid_t nPid)
+{
+    Worker* pWorker = Find(nPid);
+    if (pWorker == nullptr)
+        return;
+
+    // one byte, 1 if the start was successful, nothing if the worker ended before, the exit is handled in Reap
+    char cReady{0};
+    const ssize_t nRead = read(pWorker->fdReady, &cReady, 1);
+    m_EventLoop.RemoveFd(pWorker->fdReady);
+    close(pWorker->fdReady);
+    pWorker->fdReady = -1;
+    if (nRead != 1 || cReady != 1)
+    {
+        if (pWorker->fdPid < 0)
+            Reap(nPid);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mxWorkers);
+        pWorker->bReady = true;
+    }
+    if (pWorker->nReplaces != 0)
+    {
+        Worker* pOld = Find(pWorker->nReplaces);
+        pWorker->nReplaces = 0;
+        if (pOld != nullptr)
+            Retire(*pOld);
+    }
+
+    if (m_bStarted == false && m_bStopping == false
+        && count_if(m_vWorkers.begin(), m_vWorkers.end(), [](const Worker& W) { return W.bReady; }) == static_cast<ptrdiff_t>(m_SrvPara.nWorkers))
+    {
+        m_bStarted = true;
+        if (m_fnReady != nullptr)
+            m_fnReady(true);
+    }
+}
+
+void CSrvWorkers::Reap(pid_t nPid)
+{
+    int iStatus{0};
+    if (waitpid(nPid, &iStatus, WNOHANG) == nPid)
+        OnExit(nPid, iStatus);
+}
+
+void CSrvWorkers::OnExit(pid_t nPid, int iStatus)
+{
+    Worker* pWorker = Find(nPid);
+    if (pWorker == nullptr)
+        return;
+    const Worker W = *pWorker;
+    if (W.fdReady >= 0)
+    {
+        m_EventLoop.RemoveFd(W.fdReady);
+        close(W.fdReady);
+    }
+    if (W.fdPid >= 0)
+    {
+        m_EventLoop.RemoveFd(W.fdPid);
+        close(W.fdPid);
+    }
+    if (W.fdConfig >= 0)
+        close(W.fdConfig);
+    {
+        lock_guard<mutex> lock(m_mxWorkers);
+        m_vWorkers.erase(m_vWorkers.begin() + (pWorker - m_vWorkers.data()));
+    }
+
+    if (m_bStopping == true)
+    {
+        if (m_vWorkers.empty() == true)
+        {
+            {
+                lock_guard<mutex> lock(m_mxWorkers);
+                m_bDone = true;
+            }
+            m_cvDone.notify_all();
+        }
+        return;
+    }
+
+    if (W.bRetiring == true)
+    {
+        {
+            lock_guard<mutex> lock(m_mxWorkers);
+            ++m_nRecycles;
+        }
+        syslog(LOG_NOTICE, "worker %u (pid %d) retired", W.nIndex, static_cast<int>(nPid));
+        return;
+    }
+
+    // scale to zero: one idle worker means there is no work for the others either
+    if (m_bStarted == true && WIFEXITED(iStatus) && WEXITSTATUS(iStatus) == EXIT_IDLE)
+    {
+        syslog(LOG_NOTICE, "worker %u (pid %d) was idle, stopping", W.nIndex, static_cast<int>(nPid));
+        m_iExit = EXIT_SUCCESS;
+        StopWorkers();
+        return;
+    }
+
+    const string strHow = WIFSIGNALED(iStatus) ? "signal " + to_string(WTERMSIG(iStatus)) : "exit code " + to_string(WEXITSTATUS(iStatus));
+    syslog(LOG_WARNING, "worker %u (pid %d) ended with %s", W.nIndex, static_cast<int>(nPid), strHow.c_str());
+
+    if (m_bStarted == false)
+    {   // the service can not be started, no need to try it again and again
+        m_iExit = EXIT_FAILURE;
+        if (m_fnReady != nullptr)
+            m_fnReady(false);
+        StopWorkers();
+        return;
+    }
+    if (W.nReplaces != 0)
+    {   // the replacement failed, the old worker keeps running for now
+        m_tNextRecycle = chrono::steady_clock::now() + chrono::seconds(10);
+        return;
+    }
+    // a worker whose replacement is starting is already replaced
+    if (any_of(m_vWorkers.begin(), m_vWorkers.end(), [nPid](const Worker& N) { return N.nReplaces == nPid; }) == true)
+    {
+        for (Worker& N : m_vWorkers)
+        {
+            if (N.nReplaces == nPid)
+                N.nReplaces = 0;
+        }
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(m_mxWorkers);
+        ++m_nRestarts;
+    }
+    const uint32_t nIndex = W.nIndex;
+    if (chrono::steady_clock::now() - W.tStart < chrono::seconds(1))
+        m_EventLoop.AddTimer(chrono::seconds(1), [this, nIndex]() { if (m_bStopping == false) Spawn(nIndex, 0); }, false);
+    else
+        Spawn(nIndex, 0);
+}
+
+void CSrvWorkers::Retire(Worker& Old)
+{
+    {
+        lock_guard<mutex> lock(m_mxWorkers);
+        Old.bRetiring = true;
+    }
+    Old.tDrainEnd = chrono::steady_clock::now() + chrono::milliseconds(m_SrvPara.nWorkerDrainMs);
+    kill(Old.nPid, SIGQUIT);
+}
+
+void CSrvWorkers::Check()
+{
+    // without pidfds (Linux < 5.3) the ended workers are found here
+    vector<pid_t> vPids;
+    for (const Worker& W : m_vWorkers)
+    {
+        if (W.fdPid < 0)
+            vPids.push_back(W.nPid);
+    }
+    for (const pid_t nPid : vPids)
+        Reap(nPid);
+
+    const auto tNow = chrono::steady_clock::now();
+    for (const Worker& W : m_vWorkers)
+    {
+        if (W.bRetiring == true && tNow > W.tDrainEnd)
+            kill(W.nPid, SIGKILL);
+    }
+
+    if (m_bStarted == false || m_bStopping == true || tNow < m_tNextRecycle)
+        return;
+    // one replacement at a time
+    if (any_of(m_vWorkers.begin(), m_vWorkers.end(), [](const Worker& W) { return W.nReplaces != 0; }) == true)
+        return;
+
+    for (const Worker& W : m_vWorkers)
+    {
+        if (W.bReady == false || W.bRetiring == true)
+            continue;
+
+        string strReason;
+        if (m_SrvPara.nWorkerMaxRssKb > 0 && GetRssKb(W.nPid) > m_SrvPara.nWorkerMaxRssKb)
+            strReason = "rss above " + to_string(m_SrvPara.nWorkerMaxRssKb) + " KB";
+        else if (m_SrvPara.nWorkerMaxFds > 0 && GetFdCount(W.nPid) > m_SrvPara.nWorkerMaxFds)
+            strReason = "more than " + to_string(m_SrvPara.nWorkerMaxFds) + " fds";
+        else if (m_SrvPara.nWorkerMaxAgeS > 0 && tNow > W.tMaxAge)
+            strReason = "older than " + to_string(chrono::duration_cast<chrono::seconds>(W.tMaxAge - W.tStart).count()) + " s";
+        if (strReason.empty() == true)
+            continue;
+
+        syslog(LOG_NOTICE, "worker %u (pid %d) is replaced, %s", W.nIndex, static_cast<int>(W.nPid), strReason.c_str());
+        Spawn(W.nIndex, W.nPid);
+        break;
+    }
+}
+
+void CSrvWorkers::StopWorkers()
+{
+    if (m_bStopping == true)
+        return;
+    m_bStopping = true;
+
+    const auto tDrainEnd = chrono::steady_clock::now() + chrono::milliseconds(m_SrvPara.nWorkerDrainMs);
+    for (Worker& W : m_vWorkers)
+    {
+        if (W.bRetiring == true)
+            continue;
+        {
+            lock_guard<mutex> lock(m_mxWorkers);
+            W.bRetiring = true;
+        }
+        W.tDrainEnd = tDrainEnd;
+        kill(W.nPid, SIGQUIT);
+    }
+
+    if (m_vWorkers.empty() == true)
+    {
+        {
+            lock_guard<mutex> lock(m_mxWorkers);
+            m_bDone = true;
+        }
+        m_cvDone.notify_all();
+    }
+}
+
+void CSrvWorkers::GetStats(StatsList& lstStats)
+{
+    lock_guard<mutex> lock(m_mxWorkers);
+    lstStats.emplace_back("recycles", to_string(m_nRecycles));
+    lstStats.emplace_back("restarts", to_string(m_nRestarts));
+    const auto tNow = chrono::steady_clock::now();
+    for (const Worker& W : m_vWorkers)
+    {
+        const string strPrefix = to_string(W.nIndex) + (W.bRetiring == true ? ".retiring." : ".");
+        lstStats.emplace_back(strPrefix + "pid", to_string(W.nPid));
+        lstStats.emplace_back(strPrefix + "ready", W.bReady == true ? "1" : "0");
+        lstStats.emplace_back(strPrefix + "rss_kb", to_string(GetRssKb(W.nPid)));
+        lstStats.emplace_back(strPrefix + "fds", to_string(GetFdCount(W.nPid)));
+        lstStats.emplace_back(strPrefix + "age_s", to_string(chrono::duration_cast<chrono::seconds>(tNow - W.tStart).count()));
+    }
+}
+#endif
@@ -0,0 +1,117 @@
+/* Copyright (C) 2016-2020 Thomas Hauck - All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+
+   The author would be happy if changes and
+   improvements were reported back to him.
+
+   Author:  Thomas Hauck
+   Email:   Thomas@fam-hauck.de
+*/
+
+#ifndef SRVWORKERS_H
+#define SRVWORKERS_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include "Service.h"
+#include "SrvEventLoop.h"
+#include "SrvFileWatch.h"
+#include "SrvStats.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// The master of nWorkers worker processes. A worker that crosses nWorkerMaxRssKb, nWorkerMaxFds or its (jittered)
+// nWorkerMaxAgeS is replaced: the new worker is started, and only when it is ready the old one gets SIGQUIT and
+// drains. The workers inherit the fds of the master, so a listener (socket activation, fd store or SO_REUSEPORT)
+// never goes away. Only one worker is replaced at a time, a worker that ends unexpectedly is started again. A worker
+// gets SIGTERM like SIGQUIT, systemd sends it to all processes of the unit (KillMode=control-group).
+class CSrvWorkers
+{
+public:
+    // fnWorker runs in the new process and returns its exit code, it writes 1 to fdReady when the service is ready
+    CSrvWorkers(const SrvParam& SrvPara, std::function<int(uint32_t nIndex, int fdReady)> fnWorker);
+    ~CSrvWorkers() = default;
+    CSrvWorkers() = delete;
+    CSrvWorkers(const CSrvWorkers&) = delete;
+    CSrvWorkers(CSrvWorkers&&) = delete;
+    CSrvWorkers& operator=(const CSrvWorkers&) = delete;
+    CSrvWorkers& operator=(CSrvWorkers&&) = delete;
+
+    // starts the workers and keeps them running until Stop, returns the exit code of the master
+    int  Run();
+    void Stop();
+    // async signal safe, installed by Run: SIGQUIT, SIGTERM and SIGINT stop, all other signals go to the workers
+    static void SignalHandler(int iSignal);
+    // exit code of a worker stopped by nIdleTimeoutMs, the master stops all workers and exits with 0
+    static constexpr int EXIT_IDLE = 99;
+
+    // called when all workers are ready the first time, or one failed
+    void SetReadyCallBack(std::function<void(bool)> fnReady) { m_fnReady = fnReady; }
+    void SetStatsFile(const std::string& strStatsFile) { m_strStatsFile = strStatsFile; }
+    void GetStats(StatsList& lstStats);
+
+private:
+    struct Worker
+    {
+        pid_t    nPid{0};
+        uint32_t nIndex{0};
+        int      fdReady{-1};
+        int      fdPid{-1};
+        int      fdConfig{-1};      // socket to send the new configurations
+        bool     bReady{false};
+        bool     bRetiring{false};
+        pid_t    nReplaces{0};      // the worker that is retired when this one is ready
+        std::chrono::steady_clock::time_point tStart;
+        std::chrono::steady_clock::time_point tMaxAge;
+        std::chrono::steady_clock::time_point tDrainEnd;
+    };
+
+    // all called in the event loop thread
+    void Spawn(uint32_t nIndex, pid_t nReplaces);
+    void OnReady(pid_t nPid);
+    void Reap(pid_t nPid);
+    void OnExit(pid_t nPid, int iStatus);
+    void Retire(Worker& Old);
+    void Check();
+    void StopWorkers();
+    bool PublishConfig();
+    void PassOnConfig();
+    Worker* Find(pid_t nPid);
+
+private:
+    SrvParam                m_SrvPara;
+    std::function<int(uint32_t, int)> m_fnWorker;
+    std::function<void(bool)> m_fnReady;
+    std::string             m_strStatsFile;
+    CSrvEventLoop           m_EventLoop;
+    CSrvFileWatch           m_FileWatch;        // vWatchFiles, with a shared configuration
+
+    std::mutex              m_mxWorkers;        // m_vWorkers and m_bDone, changed only in the loop thread
+    std::condition_variable m_cvDone;
+    std::vector<Worker>     m_vWorkers;
+    bool                    m_bStarted;
+    bool                    m_bStopping;
+    bool                    m_bDone;
+    int                     m_iExit;
+    int                     m_iStatsId;
+    int                     m_fdConfig;         // sealed memfd of the current configuration
+    uint64_t                m_nGeneration;
+    uint64_t                m_nRecycles;
+    uint64_t                m_nRestarts;
+    std::chrono::steady_clock::time_point m_tNextRecycle;
+    std::mt19937            m_Random;
+    std::vector<std::pair<int, struct sigaction>> m_vOldActions;
+};
+#endif
+
+#endif // SRVWORKERS_H